@@ -1,14 +1,56 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Output printed by a block of parallel loop iterations, kept until the
+   blocks before it have printed theirs */
+struct par_output
+{
+    char *data;
+    size_t size;
+    size_t cap;
+};
+
+/* Where the current thread prints to, or NULL for stdout */
+static __thread struct par_output *par_out;
+
+static void print_line(const char *line)
+{
+    size_t len;
+    if (!par_out)
+    {
+        fputs(line, stdout);
+        return;
+    }
+    len = strlen(line);
+    if (par_out->size + len > par_out->cap)
+    {
+        par_out->cap = 2 * (par_out->size + len);
+        par_out->data = realloc(par_out->data, par_out->cap);
+        if (!par_out->data)
+            abort();
+    }
+    memcpy(par_out->data + par_out->size, line, len);
+    par_out->size += len;
+}
 
 void print_int(int v)
 {
-    printf("%d\n", v);
+    char line[16];
+    snprintf(line, sizeof(line), "%d\n", v);
+    print_line(line);
 }
 
 void print_bool(int v)
 {
-    printf("%s\n", v ? "true" : "false");
+    print_line(v ? "true\n" : "false\n");
+}
+
+void print_str(const char *s)
+{
+    fputs(s, stdout);
 }
 
 int compiler_read(char *s)
@@ -23,4 +65,114 @@ int compiler_read(char *s)
         exit(1);
     }
     return val;
-}
\ No newline at end of file
+}
+
+/* Parallel loops. The compiler outlines the body of a loop whose iterations
+   are independent into a function running the iterations from begin up to
+   end; last is set for the block holding the final iteration. par_for splits
+   the iterations into one contiguous block per thread: the calling thread
+   runs the first one and prints directly, the pool threads buffer their
+   output, which is printed in block order once all blocks are done. The
+   number of threads is PAR_THREADS or the number of online processors. */
+typedef void (*par_body)(void *ctx, long long begin, long long end, int last);
+
+#define PAR_MAX_THREADS 64
+
+static int par_threads;
+static pthread_mutex_t par_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t par_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t par_done = PTHREAD_COND_INITIALIZER;
+static unsigned long par_generation; /* Counts the loops handed to the pool */
+static int par_pending;              /* Pool threads still running a block */
+static par_body par_fn;
+static void *par_ctx;
+static long long par_trips;
+static struct par_output par_outputs[PAR_MAX_THREADS];
+
+static void par_run_block(int t)
+{
+    long long begin = par_trips * t / par_threads;
+    long long end = par_trips * (t + 1) / par_threads;
+    par_fn(par_ctx, begin, end, t == par_threads - 1);
+}
+
+static void *par_worker(void *arg)
+{
+    int t = (int)(long)arg;
+    unsigned long seen = 0;
+    par_out = &par_outputs[t];
+    for (;;)
+    {
+        pthread_mutex_lock(&par_lock);
+        while (par_generation == seen)
+            pthread_cond_wait(&par_start, &par_lock);
+        seen = par_generation;
+        pthread_mutex_unlock(&par_lock);
+
+        par_run_block(t);
+
+        pthread_mutex_lock(&par_lock);
+        if (--par_pending == 0)
+            pthread_cond_signal(&par_done);
+        pthread_mutex_unlock(&par_lock);
+    }
+    return NULL;
+}
+
+static void par_init(void)
+{
+    const char *env = getenv("PAR_THREADS");
+    long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    long t;
+    pthread_t thread;
+    if (n < 1)
+        n = 1;
+    if (n > PAR_MAX_THREADS)
+        n = PAR_MAX_THREADS;
+    par_threads = (int)n;
+    for (t = 1; t < n; ++t)
+    {
+        if (pthread_create(&thread, NULL, par_worker, (void *)t) != 0)
+        {
+            par_threads = (int)t;
+            break;
+        }
+        pthread_detach(thread);
+    }
+}
+
+void par_for(par_body fn, void *ctx, long long trips, long long min_trips)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    int t;
+    if (trips <= 0)
+        return;
+    pthread_once(&once, par_init);
+    if (par_threads == 1 || trips < min_trips)
+    {
+        fn(ctx, 0, trips, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&par_lock);
+    par_fn = fn;
+    par_ctx = ctx;
+    par_trips = trips;
+    par_pending = par_threads - 1;
+    ++par_generation;
+    pthread_cond_broadcast(&par_start);
+    pthread_mutex_unlock(&par_lock);
+
+    par_run_block(0);
+
+    pthread_mutex_lock(&par_lock);
+    while (par_pending)
+        pthread_cond_wait(&par_done, &par_lock);
+    pthread_mutex_unlock(&par_lock);
+
+    for (t = 1; t < par_threads; ++t)
+    {
+        fwrite(par_outputs[t].data, 1, par_outputs[t].size, stdout);
+        par_outputs[t].size = 0;
+    }
+}
@@ -1,6 +1,5 @@
 cd build
 cd src
-./compiler "$(cat ../../input.txt)" > compiler.ll
-llc --filetype=obj -o=compiler.o compiler.ll
-clang -o compilerbin compiler.o ../../rtCompiler.c
+./compiler "$(cat ../../input.txt)" -filetype=obj -o compiler.o "$@"
+clang -pthread -o compilerbin compiler.o ../../rtCompiler.c
 ./compilerbin
@@ -3,6 +3,7 @@
 
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include <cstdint>
 
 // Forward declarations of classes used in the AST
 class AST;
@@ -24,11 +25,56 @@ class WhileStmt;
 class elifStmt;
 class ForStmt;
 class PrintStmt;
+class SwitchStmt;
+class CaseStmt;
+class DefaultStmt;
+
+// VarRef records what Sema resolved an identifier to: the type of the variable
+// and the storage slot of its declaration. Slots are numbered separately for
+// int and bool variables so CodeGen can index its storage tables directly.
+class VarRef
+{
+public:
+  enum VarType
+  {
+    Unresolved,
+    Int,
+    Bool
+  };
+
+private:
+  VarType Type;
+  unsigned Slot;
+
+public:
+  VarRef() : Type(Unresolved), Slot(0) {}
+  VarRef(VarType Type, unsigned Slot) : Type(Type), Slot(Slot) {}
+
+  VarType getType() { return Type; }
 
-class Switchstmt;
-class Defaultstmt;
-class Casestmt;
+  unsigned getSlot() { return Slot; }
+
+  bool isBool() { return Type == Bool; }
+};
 
+// ValueRange is an interval of 32-bit values that RangeAnalysis proved a value
+// stays within. A default-constructed range means nothing is known.
+class ValueRange
+{
+  int32_t Lo;
+  int32_t Hi;
+  bool Known;
+
+public:
+  ValueRange() : Lo(INT32_MIN), Hi(INT32_MAX), Known(false) {}
+  ValueRange(int32_t Lo, int32_t Hi) : Lo(Lo), Hi(Hi), Known(true) {}
+
+  bool isKnown() { return Known; }
+
+  int32_t getLo() { return Lo; }
+
+  int32_t getHi() { return Hi; }
+};
 
 // ASTVisitor class defines a visitor pattern to traverse the AST
 class ASTVisitor
@@ -54,10 +100,9 @@ public:
   virtual void visit(elifStmt &) = 0;        // Visit the elifStmt node
   virtual void visit(ForStmt &) = 0;
   virtual void visit(PrintStmt &) = 0;
-  virtual void visit(Switchstmt &) = 0;
-  virtual void visit(Defaultstmt &) = 0;
-  virtual void visit(Casestmt &) = 0;
-  
+  virtual void visit(SwitchStmt &) = 0;  // Visit the SwitchStmt node
+  virtual void visit(CaseStmt &) = 0;    // Visit an arm of a switch
+  virtual void visit(DefaultStmt &);     // Visit the default arm, as a CaseStmt unless overridden
 };
 
 // AST class serves as the base class for all AST nodes
@@ -95,6 +140,9 @@ public:
 
   llvm::SmallVector<AST *> getdata() { return data; }
 
+  // The statement lists are exposed for passes that rewrite them in place
+  dataVector &getBody() { return data; }
+
   dataVector::const_iterator begin() { return data.begin(); }
 
   dataVector::const_iterator end() { return data.end(); }
@@ -110,12 +158,14 @@ class DeclarationInt : public Program
 {
   using VarVector = llvm::SmallVector<llvm::StringRef>;
   using ValueVector = llvm::SmallVector<Expr *>;
+  using RefVector = llvm::SmallVector<VarRef>;
   VarVector Vars;     // Stores the list of variables
   ValueVector Values; // Stores the list of initializers
+  RefVector Refs;     // Storage resolved by Sema for each variable
 
 public:
   // Declaration(llvm::SmallVector<llvm::StringRef> Vars, Expr *E) : Vars(Vars), E(E) {}
-  DeclarationInt(llvm::SmallVector<llvm::StringRef> Vars, llvm::SmallVector<Expr *> Values) : Vars(Vars), Values(Values) {}
+  DeclarationInt(llvm::SmallVector<llvm::StringRef> Vars, llvm::SmallVector<Expr *> Values) : Vars(Vars), Values(Values), Refs(Vars.size()) {}
 
   VarVector::const_iterator varBegin() { return Vars.begin(); }
 
@@ -125,6 +175,12 @@ public:
 
   ValueVector::const_iterator valEnd() { return Values.end(); }
 
+  VarRef getRef(unsigned I) { return Refs[I]; }
+
+  void setRef(unsigned I, VarRef R) { Refs[I] = R; }
+
+  void setValue(unsigned I, Expr *E) { Values[I] = E; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -136,12 +192,14 @@ class DeclarationBool : public Program
 {
   using VarVector = llvm::SmallVector<llvm::StringRef>;
   using ValueVector = llvm::SmallVector<Logic *>;
+  using RefVector = llvm::SmallVector<VarRef>;
   VarVector Vars;     // Stores the list of variables
   ValueVector Values; // Stores the list of initializers
+  RefVector Refs;     // Storage resolved by Sema for each variable
 
 public:
   // Declaration(llvm::SmallVector<llvm::StringRef> Vars, Expr *E) : Vars(Vars), E(E) {}
-  DeclarationBool(llvm::SmallVector<llvm::StringRef> Vars, llvm::SmallVector<Logic *> Values) : Vars(Vars), Values(Values) {}
+  DeclarationBool(llvm::SmallVector<llvm::StringRef> Vars, llvm::SmallVector<Logic *> Values) : Vars(Vars), Values(Values), Refs(Vars.size()) {}
 
   VarVector::const_iterator varBegin() { return Vars.begin(); }
 
@@ -151,6 +209,12 @@ public:
 
   ValueVector::const_iterator valEnd() { return Values.end(); }
 
+  VarRef getRef(unsigned I) { return Refs[I]; }
+
+  void setRef(unsigned I, VarRef R) { Refs[I] = R; }
+
+  void setValue(unsigned I, Logic *L) { Values[I] = L; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -170,6 +234,8 @@ public:
 private:
   ValueKind Kind;      // Stores the kind of Final (identifier or number or true or false)
   llvm::StringRef Val; // Stores the value of the Final
+  VarRef Ref;          // Storage resolved by Sema for an identifier
+  ValueRange Range;    // Values the identifier can have here
 
 public:
   Final(ValueKind Kind, llvm::StringRef Val) : Kind(Kind), Val(Val) {}
@@ -178,6 +244,14 @@ public:
 
   llvm::StringRef getVal() { return Val; }
 
+  VarRef getRef() { return Ref; }
+
+  void setRef(VarRef R) { Ref = R; }
+
+  ValueRange getRange() { return Range; }
+
+  void setRange(ValueRange R) { Range = R; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -203,16 +277,25 @@ private:
   Expr *Left;  // Left-hand side expression
   Expr *Right; // Right-hand side expression
   Operator Op; // Operator of the binary operation
+  bool NonNeg; // Whether the operands and the result are never negative
 
 public:
-  BinaryOp(Operator Op, Expr *L, Expr *R) : Op(Op), Left(L), Right(R) {}
+  BinaryOp(Operator Op, Expr *L, Expr *R) : Op(Op), Left(L), Right(R), NonNeg(false) {}
 
   Expr *getLeft() { return Left; }
 
   Expr *getRight() { return Right; }
 
+  void setLeft(Expr *L) { Left = L; }
+
+  void setRight(Expr *R) { Right = R; }
+
   Operator getOperator() { return Op; }
 
+  bool isNonNegative() { return NonNeg; }
+
+  void setNonNegative(bool N) { NonNeg = N; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -232,14 +315,24 @@ public:
 private:
   llvm::StringRef Ident;
   Operator Op; // Operator of the unary operation
+  VarRef Ref;  // Storage resolved by Sema for Ident
+  bool NonNeg; // Whether the variable is never negative before and after
 
 public:
-  UnaryOp(Operator Op, llvm::StringRef I) : Op(Op), Ident(I) {}
+  UnaryOp(Operator Op, llvm::StringRef I) : Op(Op), Ident(I), NonNeg(false) {}
 
   llvm::StringRef getIdent() { return Ident; }
 
+  VarRef getRef() { return Ref; }
+
+  void setRef(VarRef R) { Ref = R; }
+
   Operator getOperator() { return Op; }
 
+  bool isNonNegative() { return NonNeg; }
+
+  void setNonNegative(bool N) { NonNeg = N; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -283,6 +376,8 @@ public:
 
   Expr *getExpr() { return expr; }
 
+  void setExpr(Expr *E) { expr = E; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -307,9 +402,10 @@ private:
   Expr *RightExpr;       // Right-hand side expression
   Logic *RightLogicExpr; // Right-hand side logical expression
   AssignKind AK;         // Kind of assignment
+  bool NonNeg;           // Whether both operands of a compound assignment and its result are never negative
 
 public:
-  Assignment(Final *L, Expr *RE, AssignKind AK, Logic *RL) : Left(L), RightExpr(RE), AK(AK), RightLogicExpr(RL) {}
+  Assignment(Final *L, Expr *RE, AssignKind AK, Logic *RL) : Left(L), RightExpr(RE), AK(AK), RightLogicExpr(RL), NonNeg(false) {}
 
   Final *getLeft() { return Left; }
 
@@ -317,8 +413,16 @@ public:
 
   Logic *getRightLogic() { return RightLogicExpr; }
 
+  void setRightExpr(Expr *E) { RightExpr = E; }
+
+  void setRightLogic(Logic *L) { RightLogicExpr = L; }
+
   AssignKind getAssignKind() { return AK; }
 
+  bool isNonNegative() { return NonNeg; }
+
+  void setNonNegative(bool N) { NonNeg = N; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -354,6 +458,10 @@ public:
 
   Expr *getRight() { return Right; }
 
+  void setLeft(Expr *L) { Left = L; }
+
+  void setRight(Expr *R) { Right = R; }
+
   Operator getOperator() { return Op; }
 
   virtual void accept(ASTVisitor &V) override
@@ -384,6 +492,10 @@ public:
 
   Logic *getRight() { return Right; }
 
+  void setLeft(Logic *L) { Left = L; }
+
+  void setRight(Logic *R) { Right = R; }
+
   Operator getOperator() { return Op; }
 
   virtual void accept(ASTVisitor &V) override
@@ -405,10 +517,14 @@ public:
 
   Logic *getCond() { return Cond; }
 
+  void setCond(Logic *C) { Cond = C; }
+
   Stmts::const_iterator begin() { return S.begin(); }
 
   Stmts::const_iterator end() { return S.end(); }
 
+  Stmts &getBody() { return S; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -431,18 +547,26 @@ public:
 
   Logic *getCond() { return Cond; }
 
+  void setCond(Logic *C) { Cond = C; }
+
   BodyVector::const_iterator begin() { return ifStmts.begin(); }
 
   BodyVector::const_iterator end() { return ifStmts.end(); }
 
+  BodyVector &getBody() { return ifStmts; }
+
   BodyVector::const_iterator beginElse() { return elseStmts.begin(); }
 
   BodyVector::const_iterator endElse() { return elseStmts.end(); }
 
+  BodyVector &getElse() { return elseStmts; }
+
   elifVector::const_iterator beginElif() { return elifStmts.begin(); }
 
   elifVector::const_iterator endElif() { return elifStmts.end(); }
 
+  elifVector &getElifs() { return elifStmts; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -462,16 +586,36 @@ public:
 
   Logic *getCond() { return Cond; }
 
+  void setCond(Logic *C) { Cond = C; }
+
   BodyVector::const_iterator begin() { return Body.begin(); }
 
   BodyVector::const_iterator end() { return Body.end(); }
 
+  BodyVector &getBody() { return Body; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
   }
 };
 
+// LoopSharing records how the iterations of a for loop that ParallelLoops
+// proved independent use the variables of its body, so CodeGen can split the
+// iterations among threads. Each thread gets its own copy of the variables.
+struct LoopSharing
+{
+  bool Parallel = false;
+  int32_t Step = 0;                      // Literal the induction variable is counted by
+  Comparison::Operator Op;               // Compares the induction variable with Bound
+  Expr *Bound = nullptr;                 // Evaluated once before the loop
+  int64_t MinTrips = 0;                  // Fewer iterations run on one thread
+  llvm::SmallVector<VarRef> Shared;      // Read and never written
+  llvm::SmallVector<VarRef> Private;     // Assigned before being read in every iteration
+  llvm::SmallVector<VarRef> Sums;        // Only changed by +=, -=, ++ and --
+  llvm::SmallVector<VarRef> Products;    // Only changed by *=
+};
+
 class ForStmt : public Program
 {
   using BodyVector = llvm::SmallVector<AST *>;
@@ -482,6 +626,8 @@ private:
   Logic *Second;
   Assignment *ThirdAssign;
   UnaryOp *ThirdUnary;
+  ValueRange BodyRange; // Values the variable initialized by First has in the body
+  LoopSharing Sharing;  // How the body can run in parallel
 
 public:
   ForStmt(Assignment *First, Logic *Second, Assignment *ThirdAssign, UnaryOp *ThirdUnary, llvm::SmallVector<AST *> Body) : First(First), Second(Second), ThirdAssign(ThirdAssign), ThirdUnary(ThirdUnary), Body(Body) {}
@@ -490,14 +636,24 @@ public:
 
   Logic *getSecond() { return Second; }
 
+  void setSecond(Logic *S) { Second = S; }
+
   Assignment *getThirdAssign() { return ThirdAssign; }
 
   UnaryOp *getThirdUnary() { return ThirdUnary; }
 
+  ValueRange getBodyRange() { return BodyRange; }
+
+  void setBodyRange(ValueRange R) { BodyRange = R; }
+
+  LoopSharing &getSharing() { return Sharing; }
+
   BodyVector::const_iterator begin() { return Body.begin(); }
 
   BodyVector::const_iterator end() { return Body.end(); }
 
+  BodyVector &getBody() { return Body; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
@@ -508,56 +664,120 @@ class PrintStmt : public Program
 {
 private:
   llvm::StringRef Var;
+  VarRef Ref; // Storage resolved by Sema for Var
 
 public:
   PrintStmt(llvm::StringRef Var) : Var(Var) {}
 
   llvm::StringRef getVar() { return Var; }
 
+  VarRef getRef() { return Ref; }
+
+  void setRef(VarRef R) { Ref = R; }
+
   virtual void accept(ASTVisitor &V) override
   {
     V.visit(*this);
   }
 };
-//============================================================================================================================================
-class SwitchStmt : public AST {
+// CaseStmt is one arm of a switch. Control enters at the arm whose value
+// equals the switch expression and falls through the arms after it to the end
+// of the switch.
+class CaseStmt : public Program
+{
+  using BodyVector = llvm::SmallVector<AST *>;
+
+private:
+  Expr *Value; // Null for the default arm
+  int32_t Literal; // Value of the label, set by Sema
+  BodyVector Body;
+
 public:
-    AST *condition; // The switch condition
-    std::vector<CaseStmt *> cases;
-    DefaultStmt *defaultCase; // Optional default case
+  CaseStmt(Expr *Value, llvm::SmallVector<AST *> Body) : Value(Value), Literal(0), Body(Body) {}
 
-    SwitchStmt(AST *condition, std::vector<CaseStmt *> cases, DefaultStmt *defaultCase = nullptr)
-        : condition(condition), cases(std::move(cases)), defaultCase(defaultCase) {}
+  Expr *getValue() { return Value; }
 
-    void accept(ASTVisitor &visitor) override {
-        visitor.visit(*this);
-    }
+  bool isDefault() { return Value == nullptr; }
+
+  int32_t getLiteral() { return Literal; }
+
+  void setLiteral(int32_t L) { Literal = L; }
+
+  BodyVector::const_iterator begin() { return Body.begin(); }
+
+  BodyVector::const_iterator end() { return Body.end(); }
+
+  BodyVector &getBody() { return Body; }
+
+  virtual void accept(ASTVisitor &V) override
+  {
+    V.visit(*this);
+  }
 };
 
-class CaseStmt : public AST {
+// DefaultStmt is the arm of a switch entered when no case matches
+class DefaultStmt : public CaseStmt
+{
 public:
-    AST *value;             // The value for this case
-    // std::vector<AST *> body; // The body of the case
-    llvm::SmallVector<AST *> body;
-
-    CaseStmt(AST *value, std::vector<AST *> body) : value(value), body(std::move(body)) {}//==========================================================================have to make a change move
+  DefaultStmt(llvm::SmallVector<AST *> Body) : CaseStmt(nullptr, Body) {}
 
-    void accept(ASTVisitor &visitor) override {
-        visitor.visit(*this);
-    }
+  virtual void accept(ASTVisitor &V) override
+  {
+    V.visit(*this);
+  }
 };
 
-class DefaultStmt : public AST {
+class SwitchStmt : public Program
+{
+  using CaseVector = llvm::SmallVector<CaseStmt *>;
+
+private:
+  Expr *Cond;
+  CaseVector Cases; // In source order, the default arm included
+
 public:
-    // std::vector<AST *> body;
-    llvm::SmallVector<AST *> body;
+  SwitchStmt(Expr *Cond, llvm::SmallVector<CaseStmt *> Cases) : Cond(Cond), Cases(Cases) {}
+
+  Expr *getCond() { return Cond; }
 
-    DefaultStmt(std::vector<AST *> body) : body(std::move(body)) {}//======================================================================================
+  void setCond(Expr *C) { Cond = C; }
 
-    void accept(ASTVisitor &visitor) override {
-        visitor.visit(*this);
+  CaseVector::const_iterator begin() { return Cases.begin(); }
+
+  CaseVector::const_iterator end() { return Cases.end(); }
+
+  CaseVector &getCases() { return Cases; }
+
+  // Returns the default arm, or null if there is none
+  DefaultStmt *getDefault()
+  {
+    for (CaseStmt *C : Cases)
+      if (C->isDefault())
+        return static_cast<DefaultStmt *>(C);
+    return nullptr;
+  }
+
+  // Returns the arm control enters when the switch expression is V, or end()
+  // if no label matches and there is no default arm
+  CaseVector::const_iterator findArm(int32_t V)
+  {
+    CaseVector::const_iterator Default = end();
+    for (CaseVector::const_iterator I = begin(), E = end(); I != E; ++I)
+    {
+      if ((*I)->isDefault())
+        Default = I;
+      else if ((*I)->getLiteral() == V)
+        return I;
     }
+    return Default;
+  }
+
+  virtual void accept(ASTVisitor &V) override
+  {
+    V.visit(*this);
+  }
 };
 
+inline void ASTVisitor::visit(DefaultStmt &Node) { visit(static_cast<CaseStmt &>(Node)); }
 
 #endif
@@ -1,16 +1,286 @@
 #include "CodeGen.h"
-#include "llvm/ADT/StringMap.h"
+#include "Runtime.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+#include <algorithm>
 
 using namespace llvm;
 
-// Define a visitor class for generating LLVM IR from the AST.
+// Base ^ N with the wrapping multiplications of the generated code
+static uint32_t power(uint32_t Base, uint32_t N)
+{
+  uint32_t Result = 1;
+  for (; N; N >>= 1)
+  {
+    if (N & 1)
+      Result *= Base;
+    Base *= Base;
+  }
+  return Result;
+}
+
+// Extends Chain, a star chain, to end at N within Length elements. In a star
+// chain each element after the first is the previous one plus an earlier one.
+static bool extendChain(SmallVectorImpl<uint32_t> &Chain, unsigned Length, uint32_t N)
+{
+  uint64_t Last = Chain.back();
+  if (Last == N)
+    return true;
+  // Even doubling at every step left cannot reach N
+  if (Chain.size() == Length || (Last << (Length - Chain.size())) < N)
+    return false;
+  for (unsigned I = Chain.size(); I--;)
+  {
+    uint64_t Next = Last + Chain[I];
+    if (Next > N)
+      continue;
+    Chain.push_back(Next);
+    if (extendChain(Chain, Length, N))
+      return true;
+    Chain.pop_back();
+  }
+  return false;
+}
+
+// Exponents below this get a shortest star chain, searched in well under a
+// millisecond; the search grows quickly past it, so larger ones take the
+// chain of square-and-multiply
+static const uint32_t SearchedExponents = 128;
+
+// Returns an addition chain for N > 0: it starts at 1 and ends at N, and x^N
+// takes one multiplication per element after the first. The shortest star
+// chains are the shortest chains for every N below 12509: x^15 takes 5
+// multiplications where square-and-multiply takes 6.
+static SmallVector<uint32_t, 16> expChain(uint32_t N)
+{
+  SmallVector<uint32_t, 16> Chain = {1};
+  if (N < SearchedExponents)
+  {
+    for (unsigned Length = Log2_32_Ceil(N) + 1;; ++Length)
+      if (extendChain(Chain, Length, N))
+        return Chain;
+  }
+  // Square for each bit after the highest, and multiply by x for each set one
+  for (unsigned Bit = Log2_32(N); Bit--;)
+  {
+    Chain.push_back(Chain.back() * 2);
+    if (N >> Bit & 1)
+      Chain.push_back(Chain.back() + 1);
+  }
+  return Chain;
+}
+
 namespace
 ns{
+  // Recognizes a condition that tests an int variable for equality with a
+  // literal, like `x == 3` or `-1 == x`.
+  class CaseTest : public ASTVisitor
+  {
+    Final *Var;
+    int32_t Value;
+    bool HasValue;
+    bool Failed;
+
+    void fail() { Failed = true; }
+
+  public:
+    // Returns whether Cond is such a test, and the variable and the literal it
+    // compares.
+    bool match(Logic *Cond, Final *&TestedVar, int32_t &TestedValue)
+    {
+      Var = nullptr;
+      HasValue = false;
+      Failed = false;
+      Cond->accept(*this);
+      if (Failed || !Var || !HasValue)
+        return false;
+      TestedVar = Var;
+      TestedValue = Value;
+      return true;
+    }
+
+    // A parenthesized condition
+    virtual void visit(LogicalExpr &Node) override
+    {
+      if (Node.getRight())
+        fail();
+      else
+        Node.getLeft()->accept(*this);
+    };
+
+    virtual void visit(Comparison &Node) override
+    {
+      if (Node.getOperator() != Comparison::Equal || !Node.getRight())
+        return fail();
+      Node.getLeft()->accept(*this);
+      Node.getRight()->accept(*this);
+    };
+
+    virtual void visit(Final &Node) override
+    {
+      if (Node.getKind() == Final::Ident)
+      {
+        if (Var || Node.getRef().isBool())
+          return fail();
+        Var = &Node;
+        return;
+      }
+      if (HasValue || Node.getVal().getAsInteger(10, Value))
+        return fail();
+      HasValue = true;
+    };
+
+    virtual void visit(SignedNumber &Node) override
+    {
+      if (HasValue || Node.getValue().getAsInteger(10, Value))
+        return fail();
+      if (Node.getSign() == SignedNumber::Minus)
+        Value = -Value;
+      HasValue = true;
+    };
+
+    virtual void visit(BinaryOp &) override { fail(); };
+    virtual void visit(UnaryOp &) override { fail(); };
+    virtual void visit(NegExpr &) override { fail(); };
+    virtual void visit(Assignment &) override { fail(); };
+    virtual void visit(DeclarationInt &) override { fail(); };
+    virtual void visit(DeclarationBool &) override { fail(); };
+    virtual void visit(IfStmt &) override { fail(); };
+    virtual void visit(WhileStmt &) override { fail(); };
+    virtual void visit(elifStmt &) override { fail(); };
+    virtual void visit(ForStmt &) override { fail(); };
+    virtual void visit(PrintStmt &) override { fail(); };
+    virtual void visit(SwitchStmt &) override { fail(); };
+    virtual void visit(CaseStmt &) override { fail(); };
+  };
+
+  // Right operands of 'and'/'or' of at most this many instructions are
+  // evaluated even when the left one decides the result, which is cheaper
+  // than a branch around them that may be mispredicted.
+  static const unsigned CheapOperand = 8;
+
+  // Decides whether the right operand of 'and'/'or' may be evaluated without
+  // a branch: it must not change a variable with ++ or --, divide, which may
+  // trap, or run the loop of a '^', and must take few instructions.
+  class CheapTest : public ASTVisitor
+  {
+    unsigned Instructions;
+    bool Costly;
+    bool IsLiteral;  // Whether the expression visited last is a literal
+    int64_t Literal; // Its value then
+
+    void count(AST *Node)
+    {
+      IsLiteral = false;
+      if (Node && !Costly)
+        Node->accept(*this);
+    }
+
+    void add(unsigned N)
+    {
+      Instructions += N;
+      if (Instructions > CheapOperand)
+        Costly = true;
+    }
+
+    void fail() { Costly = true; }
+
+  public:
+    bool isCheap(Logic *Operand)
+    {
+      Instructions = 0;
+      Costly = false;
+      count(Operand);
+      return !Costly;
+    }
+
+    virtual void visit(Final &Node) override
+    {
+      if (Node.getKind() == Final::Ident)
+        return add(1);
+      IsLiteral = !Node.getVal().getAsInteger(10, Literal);
+    };
+
+    virtual void visit(SignedNumber &Node) override
+    {
+      IsLiteral = !Node.getValue().getAsInteger(10, Literal);
+      if (Node.getSign() == SignedNumber::Minus)
+        Literal = -Literal;
+    };
+
+    virtual void visit(NegExpr &Node) override
+    {
+      count(Node.getExpr());
+      add(1);
+    };
+
+    virtual void visit(BinaryOp &Node) override
+    {
+      count(Node.getLeft());
+      count(Node.getRight());
+      switch (Node.getOperator())
+      {
+      case BinaryOp::Div:
+      case BinaryOp::Mod:
+        return fail();
+      case BinaryOp::Exp:
+        // A literal exponent takes a chain of at most one squaring per bit
+        // and one multiplication per set bit after the first
+        if (!IsLiteral)
+          return fail();
+        if (Literal > 0)
+          add(Log2_64(Literal) + countPopulation((uint64_t)Literal));
+        break;
+      default:
+        add(1);
+        break;
+      }
+      IsLiteral = false;
+    };
+
+    virtual void visit(Comparison &Node) override
+    {
+      count(Node.getLeft());
+      count(Node.getRight());
+      add(1);
+    };
+
+    virtual void visit(LogicalExpr &Node) override
+    {
+      count(Node.getLeft());
+      count(Node.getRight());
+      add(1);
+    };
+
+    virtual void visit(UnaryOp &) override { fail(); };
+    virtual void visit(Assignment &) override { fail(); };
+    virtual void visit(DeclarationInt &) override { fail(); };
+    virtual void visit(DeclarationBool &) override { fail(); };
+    virtual void visit(IfStmt &) override { fail(); };
+    virtual void visit(WhileStmt &) override { fail(); };
+    virtual void visit(elifStmt &) override { fail(); };
+    virtual void visit(ForStmt &) override { fail(); };
+    virtual void visit(PrintStmt &) override { fail(); };
+    virtual void visit(SwitchStmt &) override { fail(); };
+    virtual void visit(CaseStmt &) override { fail(); };
+  };
+
+  // Define a visitor class for generating LLVM IR from the AST.
   class ToIRVisitor : public ASTVisitor
   {
     Module *M;
@@ -18,6 +288,7 @@ ns{
     Type *VoidTy;
     Type *Int1Ty;
     Type *Int32Ty;
+    Type *Int64Ty;
     Type *Int8PtrTy;
     Type *Int8PtrPtrTy;
     Constant *Int32Zero;
@@ -26,8 +297,8 @@ ns{
     Constant *Int1True;
 
     Value *V;
-    StringMap<AllocaInst *> nameMapInt;
-    StringMap<AllocaInst *> nameMapBool;
+    SmallVector<Value *> IntSlots;  // Storage of int variables, indexed by Sema's slot
+    SmallVector<Value *> BoolSlots; // Storage of bool variables, indexed by Sema's slot
 
     FunctionType *PrintIntFnTy;
     Function *PrintIntFn;
@@ -35,14 +306,45 @@ ns{
     FunctionType *PrintBoolFnTy;
     Function *PrintBoolFn;
 
+    // In SSA mode variables have no storage: their values are tracked per
+    // block while the code is generated and joined by phis, following Braun
+    // et al., "Simple and Efficient Construction of Static Single Assignment
+    // Form". A variable is keyed by its slot*2+isBool.
+    bool SSA;
+    DenseMap<std::pair<unsigned, BasicBlock *>, Value *> CurrentDef;
+    DenseMap<BasicBlock *, SmallVector<std::pair<unsigned, PHINode *>, 4>> IncompletePhis;
+    DenseSet<BasicBlock *> Sealed;  // Blocks whose predecessors are all known
+    DenseSet<PHINode *> Incomplete; // Phis whose operands are not all known yet
+    // Trivial phis taken out of their blocks, and the values replacing them.
+    // They stay allocated until the module is done, as CurrentDef may still
+    // name them.
+    DenseMap<PHINode *, Value *> Replaced;
+
+    // The loop whose body is being outlined for ParallelLoops, if any. Its sums
+    // and products hold the partial result of one thread there.
+    ForStmt *Outlined = nullptr;
+
+    // For runLoop: the loop entered at its header, the arrays the variables
+    // are handed over in, and the slots loaded from them
+    AST *Resumed = nullptr;
+    Value *StateInts = nullptr;
+    Value *StateBools = nullptr;
+    SmallVector<std::pair<VarRef, Value *>, 8> StateSlots;
+
+    // Whether the code being generated also runs where the left operand of an
+    // 'and'/'or' decided the result, so the ranges RangeAnalysis found for it
+    // may not hold
+    bool Speculated = false;
+
   public:
     // Constructor for the visitor class.
-    ToIRVisitor(Module *M) : M(M), Builder(M->getContext())
+    ToIRVisitor(Module *M, bool SSA = false) : M(M), Builder(M->getContext()), SSA(SSA)
     {
       // Initialize LLVM types and constants.
       VoidTy = Type::getVoidTy(M->getContext());
       Int1Ty = Type::getInt1Ty(M->getContext());
       Int32Ty = Type::getInt32Ty(M->getContext());
+      Int64Ty = Type::getInt64Ty(M->getContext());
       Int8PtrTy = Type::getInt8PtrTy(M->getContext());
       Int8PtrPtrTy = Int8PtrTy->getPointerTo();
 
@@ -71,12 +373,73 @@ ns{
       // Create a basic block for the entry point of the main function.
       BasicBlock *BB = BasicBlock::Create(M->getContext(), "entry", MainFn);
       Builder.SetInsertPoint(BB);
+      sealBlock(BB);
 
       // Visit the root node of the AST to generate IR.
       Tree->accept(*this);
 
       // Create a return instruction at the end of the main function.
       Builder.CreateRet(Int32Zero);
+
+      for (std::pair<PHINode *, Value *> R : Replaced)
+        R.first->dropAllReferences();
+      for (std::pair<PHINode *, Value *> R : Replaced)
+        R.first->deleteValue();
+    }
+
+    // Generates a top-level statement as the function `void Name()`. The
+    // top-level variables in Globals are kept in globals named `v.<name>`,
+    // declared by the module, so the functions of the statements of a
+    // program can be generated separately.
+    Function *runStatement(AST *Stmt, StringRef Name, ArrayRef<std::pair<StringRef, VarRef>> Globals)
+    {
+      Function *Fn = Function::Create(FunctionType::get(VoidTy, false), GlobalValue::InternalLinkage, Name, M);
+      Builder.SetInsertPoint(BasicBlock::Create(M->getContext(), "entry", Fn));
+      IntSlots.clear();
+      BoolSlots.clear();
+      for (std::pair<StringRef, VarRef> G : Globals)
+      {
+        SmallVector<Value *> &Slots = G.second.isBool() ? BoolSlots : IntSlots;
+        if (Slots.size() <= G.second.getSlot())
+          Slots.resize(G.second.getSlot() + 1, nullptr);
+        Slots[G.second.getSlot()] = M->getOrInsertGlobal(("v." + G.first).str(), G.second.isBool() ? Int1Ty : Int32Ty);
+      }
+      Stmt->accept(*this);
+      Builder.CreateRetVoid();
+      return Fn;
+    }
+
+    // Generates a loop of the program as the LoopJIT::LoopFn `void Name(i32 *Ints,
+    // i1 *Bools)`. Each variable the loop uses gets a stack slot loaded from
+    // the arrays in the entry block and stored back when the loop exits; mem2reg
+    // keeps them in registers in between. Returns in NumInts and NumBools the
+    // number of slots of each array the function uses.
+    Function *runLoop(AST *Loop, StringRef Name, unsigned &NumInts, unsigned &NumBools)
+    {
+      FunctionType *FnTy = FunctionType::get(VoidTy, {Int32Ty->getPointerTo(), Int1Ty->getPointerTo()}, false);
+      Function *Fn = Function::Create(FnTy, GlobalValue::ExternalLinkage, Name, M);
+      Builder.SetInsertPoint(BasicBlock::Create(M->getContext(), "entry", Fn));
+      IntSlots.clear();
+      BoolSlots.clear();
+      StateSlots.clear();
+      Resumed = Loop;
+      StateInts = Fn->getArg(0);
+      StateBools = Fn->getArg(1);
+
+      Loop->accept(*this);
+      for (std::pair<VarRef, Value *> S : StateSlots)
+      {
+        Type *Ty = S.first.isBool() ? Int1Ty : Int32Ty;
+        Value *State = S.first.isBool() ? StateBools : StateInts;
+        Builder.CreateStore(Builder.CreateLoad(Ty, S.second), Builder.CreateConstGEP1_32(Ty, State, S.first.getSlot()));
+      }
+      Builder.CreateRetVoid();
+
+      NumInts = IntSlots.size();
+      NumBools = BoolSlots.size();
+      Resumed = nullptr;
+      StateInts = StateBools = nullptr;
+      return Fn;
     }
 
     // Visit function for the Program node in the AST.
@@ -106,24 +469,17 @@ ns{
         }
         E++;
       }
-      StringRef Var;
-      Value* val;
       llvm::SmallVector<Value *, 8>::const_iterator itVal = vals.begin();
-      for (llvm::SmallVector<llvm::StringRef, 8>::const_iterator S = Node.varBegin(), End = Node.varEnd(); S != End; ++S){
-        
-        Var = *S;
+      for (unsigned I = 0, End = Node.varEnd() - Node.varBegin(); I != End; ++I){
 
         // Create an alloca instruction to allocate memory for the variable.
-        nameMapInt[Var] = Builder.CreateAlloca(Int32Ty);
+        createSlot(Node.getRef(I));
         
-        // Store the initial value (if any) in the variable's memory location.
+        // Store the initial value in the variable's memory location. There is none
+        // if DeadInit proved it is overwritten before any read.
         if (*itVal != nullptr)
         {
-          Builder.CreateStore(*itVal, nameMapInt[Var]);
-        }
-        else
-        {
-          Builder.CreateStore(Int32Zero, nameMapInt[Var]);
+          storeSlot(Node.getRef(I), *itVal);
         }
         itVal++;
       }
@@ -146,24 +502,17 @@ ns{
         }
         L++;
       }
-      StringRef Var;
-      Value* val;
       llvm::SmallVector<Value *, 8>::const_iterator itVal = vals.begin();
-      for (llvm::SmallVector<llvm::StringRef, 8>::const_iterator S = Node.varBegin(), End = Node.varEnd(); S != End; ++S){
-        
-        Var = *S;
+      for (unsigned I = 0, End = Node.varEnd() - Node.varBegin(); I != End; ++I){
 
         // Create an alloca instruction to allocate memory for the variable.
-        nameMapBool[Var] = Builder.CreateAlloca(Int1Ty);
+        createSlot(Node.getRef(I));
         
-        // Store the initial value (if any) in the variable's memory location.
+        // Store the initial value in the variable's memory location. There is none
+        // if DeadInit proved it is overwritten before any read.
         if (*itVal != nullptr)
         {
-          Builder.CreateStore(*itVal, nameMapBool[Var]);
-        }
-        else
-        {
-          Builder.CreateStore(Int1False, nameMapBool[Var]);
+          storeSlot(Node.getRef(I), *itVal);
         }
         itVal++;
       }
@@ -171,9 +520,13 @@ ns{
     // TODO
     virtual void visit(Assignment &Node) override
     {
-      // Get the name of the variable being assigned.
-      llvm::StringRef varName = Node.getLeft()->getVal();
-      Node.getLeft()->accept(*this);
+      // Get the storage of the variable being assigned.
+      VarRef Ref = Node.getLeft()->getRef();
+      bool Partial = isPartial(Ref);
+      if (Partial)
+        V = loadSlot(Ref);
+      else
+        Node.getLeft()->accept(*this);
       Value *varVal = V;
 
       if (Node.getRightExpr() == nullptr)
@@ -183,29 +536,29 @@ ns{
 
       Value *val = V;
 
+      // RangeAnalysis proved the unsigned forms valid if the values are never negative.
+      // A partial result of a thread may overflow where the whole one does not.
+      bool NonNeg = Node.isNonNegative() && !Partial;
       switch (Node.getAssignKind())
       {
       case Assignment::Plus_assign:
-        val = Builder.CreateNSWAdd(varVal, val);
+        val = Builder.CreateAdd(varVal, val, "", NonNeg, !Partial);
         break;
       case Assignment::Minus_assign:
-        val = Builder.CreateNSWSub(varVal, val);
+        val = Builder.CreateSub(varVal, val, "", NonNeg, !Partial);
         break;
       case Assignment::Star_assign:
-        val = Builder.CreateNSWMul(varVal, val);
+        val = Builder.CreateMul(varVal, val, "", NonNeg, !Partial);
         break;
       case Assignment::Slash_assign:
-        val = Builder.CreateSDiv(varVal, val);
+        val = NonNeg ? Builder.CreateUDiv(varVal, val) : Builder.CreateSDiv(varVal, val);
         break;
       default:
         break;
       }
 
       // Create a store instruction to assign the value to the variable.
-      if (isBool(((Final*)Node.getLeft())->getVal()))
-        Builder.CreateStore(val, nameMapBool[varName]);
-      else
-        Builder.CreateStore(val, nameMapInt[varName]);
+      storeSlot(Ref, val);
 
     };
 
@@ -213,11 +566,14 @@ ns{
     {
       if (Node.getKind() == Final::Ident)
       {
-        // If the Final is an identifier, load its value from memory.
-        if (isBool(Node.getVal()))
-          V = Builder.CreateLoad(Int1Ty, nameMapBool[Node.getVal()]);
-        else
-          V = Builder.CreateLoad(Int32Ty, nameMapInt[Node.getVal()]);
+        // If the Final is an identifier, load its value from memory, noting the
+        // values RangeAnalysis proved it can have. Range metadata only goes on
+        // loads, so SSA values go without.
+        V = loadSlot(Node.getRef());
+        ValueRange Range = Node.getRange();
+        if (LoadInst *Load = dyn_cast<LoadInst>(V))
+          if (Range.isKnown() && !Speculated)
+            Load->setMetadata(LLVMContext::MD_range, MDBuilder(M->getContext()).createRange(APInt(32, Range.getLo(), true), APInt(32, Range.getHi(), true) + 1));
       }
       else
       {
@@ -239,22 +595,24 @@ ns{
       Value *Right = V;
 
       // Perform the binary operation based on the operator type and create the corresponding instruction.
+      // RangeAnalysis proved the unsigned forms valid if the values are never negative.
+      bool NonNeg = Node.isNonNegative();
       switch (Node.getOperator())
       {
       case BinaryOp::Plus:
-        V = Builder.CreateNSWAdd(Left, Right);
+        V = Builder.CreateAdd(Left, Right, "", NonNeg, true);
         break;
       case BinaryOp::Minus:
-        V = Builder.CreateNSWSub(Left, Right);
+        V = Builder.CreateSub(Left, Right, "", NonNeg, true);
         break;
       case BinaryOp::Mul:
-        V = Builder.CreateNSWMul(Left, Right);
+        V = Builder.CreateMul(Left, Right, "", NonNeg, true);
         break;
       case BinaryOp::Div:
-        V = Builder.CreateSDiv(Left, Right);
+        V = NonNeg ? Builder.CreateUDiv(Left, Right) : Builder.CreateSDiv(Left, Right);
         break;
       case BinaryOp::Mod:
-        V = Builder.CreateSRem(Left, Right);
+        V = NonNeg ? Builder.CreateURem(Left, Right) : Builder.CreateSRem(Left, Right);
         break;
       case BinaryOp::Exp:
         V = CreateExp(Left, Right);
@@ -264,58 +622,108 @@ ns{
       }
     };
 
+    // Lowers Left ^ Right: Left multiplied Right times, and 1 for Right <= 0.
+    // A constant exponent becomes a chain of multiplications, a constant base
+    // a shift or a select where it can, and anything else a square-and-multiply
+    // loop running once per bit of the exponent.
     Value* CreateExp(Value *Left, Value *Right)
     {
-      AllocaInst* counterAlloca = Builder.CreateAlloca(Int32Ty);
-      AllocaInst* resultAlloca = Builder.CreateAlloca(Int32Ty);
-      Builder.CreateStore(Int32Zero, counterAlloca);
-      Builder.CreateStore(Int32One, resultAlloca);
-
-      llvm::BasicBlock* ForCondBB = llvm::BasicBlock::Create(M->getContext(), "exp.cond", Builder.GetInsertBlock()->getParent());
-      llvm::BasicBlock* ForBodyBB = llvm::BasicBlock::Create(M->getContext(), "exp.body", Builder.GetInsertBlock()->getParent());
-      llvm::BasicBlock* AfterForBB = llvm::BasicBlock::Create(M->getContext(), "after.exp", Builder.GetInsertBlock()->getParent());
-
-      Builder.CreateBr(ForCondBB); //?
-
-      Builder.SetInsertPoint(ForCondBB);
-      Value* counterLoad = Builder.CreateLoad(counterAlloca);
-
-      Value *cond = Builder.CreateICmpSLT(counterLoad, Right);
-      Builder.CreateCondBr(cond, ForBodyBB, AfterForBB);
-
-      Builder.SetInsertPoint(ForBodyBB);
-      Value* resultLoad = Builder.CreateLoad(resultAlloca);
-
-      Value* resultMul = Builder.CreateMul(resultLoad, Left);
-      Value* counterInc = Builder.CreateAdd(counterLoad, Int32One);
-      Builder.CreateStore(resultMul, resultAlloca);
-      Builder.CreateStore(counterInc, counterAlloca);
+      ConstantInt *Base = dyn_cast<ConstantInt>(Left);
+      ConstantInt *Exponent = dyn_cast<ConstantInt>(Right);
+      if (Exponent)
+      {
+        int32_t N = Exponent->getSExtValue();
+        if (N <= 0)
+          return Int32One;
+        if (Base)
+          return ConstantInt::get(Int32Ty, power(Base->getZExtValue(), N));
+        // Each element of the chain is the previous one times an earlier one
+        SmallVector<uint32_t, 16> Chain = expChain(N);
+        SmallVector<Value *, 16> Powers = {Left};
+        for (unsigned I = 1, E = Chain.size(); I != E; ++I)
+        {
+          unsigned J = std::find(Chain.begin(), Chain.end(), Chain[I] - Chain[I - 1]) - Chain.begin();
+          Powers.push_back(Builder.CreateMul(Powers[I - 1], Powers[J]));
+        }
+        return Powers.back();
+      }
 
-      Builder.CreateBr(ForCondBB);
-      Builder.SetInsertPoint(AfterForBB);
+      Value *Positive = Builder.CreateICmpSGT(Right, Int32Zero);
+      if (Base)
+      {
+        int32_t B = Base->getSExtValue();
+        if (B == 0)
+          return Builder.CreateZExt(Builder.CreateNot(Positive), Int32Ty);
+        if (B == 1)
+          return Int32One;
+        if (B == -1)
+        {
+          Value *Odd = Builder.CreateTrunc(Right, Int1Ty);
+          return Builder.CreateSelect(Builder.CreateAnd(Positive, Odd), Base, Int32One);
+        }
+        if (B > 0 && isPowerOf2_32(B))
+        {
+          // 2^K ^ Right is 1 << K * Right, which is 0 once the shift passes
+          // the width; the shift is poison there, but not selected
+          unsigned K = Log2_32(B);
+          Value *Shifted = Builder.CreateShl(Int32One, Builder.CreateMul(Right, ConstantInt::get(Int32Ty, K)));
+          Value *Wide = Builder.CreateICmpSGT(Right, ConstantInt::get(Int32Ty, 31 / K));
+          return Builder.CreateSelect(Positive, Builder.CreateSelect(Wide, Int32Zero, Shifted), Int32One);
+        }
+      }
 
-      Value* result = Builder.CreateLoad(resultAlloca);
-      return result;
+      // The loop multiplies the result by the base for each set bit of the
+      // exponent, lowest first, squaring the base in between. Its state is
+      // in phis, so it needs no stack slots.
+      Function *Fn = Builder.GetInsertBlock()->getParent();
+      BasicBlock *BeforeBB = Builder.GetInsertBlock();
+      BasicBlock *LoopBB = BasicBlock::Create(M->getContext(), "exp.loop", Fn);
+      BasicBlock *AfterBB = BasicBlock::Create(M->getContext(), "after.exp", Fn);
+      Builder.CreateCondBr(Positive, LoopBB, AfterBB);
+
+      Builder.SetInsertPoint(LoopBB);
+      PHINode *Bits = Builder.CreatePHI(Int32Ty, 2);
+      PHINode *Square = Builder.CreatePHI(Int32Ty, 2);
+      PHINode *Product = Builder.CreatePHI(Int32Ty, 2);
+      Value *Multiplied = Builder.CreateMul(Product, Square);
+      Value *NextProduct = Builder.CreateSelect(Builder.CreateTrunc(Bits, Int1Ty), Multiplied, Product);
+      Value *NextSquare = Builder.CreateMul(Square, Square);
+      Value *NextBits = Builder.CreateLShr(Bits, Int32One);
+      Bits->addIncoming(Right, BeforeBB);
+      Bits->addIncoming(NextBits, LoopBB);
+      Square->addIncoming(Left, BeforeBB);
+      Square->addIncoming(NextSquare, LoopBB);
+      Product->addIncoming(Int32One, BeforeBB);
+      Product->addIncoming(NextProduct, LoopBB);
+      Builder.CreateCondBr(Builder.CreateICmpNE(NextBits, Int32Zero), LoopBB, AfterBB);
+      sealBlock(LoopBB);
+      sealBlock(AfterBB);
+
+      Builder.SetInsertPoint(AfterBB);
+      PHINode *Result = Builder.CreatePHI(Int32Ty, 2);
+      Result->addIncoming(Int32One, BeforeBB);
+      Result->addIncoming(NextProduct, LoopBB);
+      return Result;
     }
 
     virtual void visit(UnaryOp &Node) override
     {
       // Visit the left-hand side of the binary operation and get its value.
-      Value *Left = Builder.CreateLoad(Int32Ty, nameMapInt[Node.getIdent()]);;
+      Value *Left = loadSlot(Node.getRef());
 
       // Perform the binary operation based on the operator type and create the corresponding instruction.
       switch (Node.getOperator())
       {
       case UnaryOp::Plus_plus:
-        V = Builder.CreateNSWAdd(Left, Int32One);
+        V = isPartial(Node.getRef()) ? Builder.CreateAdd(Left, Int32One) : Builder.CreateAdd(Left, Int32One, "", Node.isNonNegative(), true);
         break;
       case UnaryOp::Minus_minus:
-        V = Builder.CreateNSWSub(Left, Int32One);
+        V = isPartial(Node.getRef()) ? Builder.CreateSub(Left, Int32One) : Builder.CreateSub(Left, Int32One, "", Node.isNonNegative(), true);
       default:
         break;
       }
       
-      Builder.CreateStore(V, nameMapInt[Node.getIdent()]);
+      storeSlot(Node.getRef(), V);
     };
 
     virtual void visit(SignedNumber &Node) override
@@ -341,21 +749,44 @@ ns{
         V = Left;
         return; 
       }
-      // Visit the right-hand side of the Logical operation and get its value.
-      Node.getRight()->accept(*this);
-      Value *Right = V;
+      bool And = Node.getOperator() == LogicalExpr::And;
 
-      switch (Node.getOperator())
+      // A cheap right operand is evaluated either way and picked by a select,
+      // which unlike and/or ignores the poison it may give where it should
+      // not have run.
+      if (CheapTest().isCheap(Node.getRight()))
       {
-      case LogicalExpr::And:
-        V = Builder.CreateAnd(Left, Right);
-        break;
-      case LogicalExpr::Or:
-        V = Builder.CreateOr(Left, Right);
-        break;
-      default:
-        break;
+        bool Saved = Speculated;
+        Speculated = true;
+        Node.getRight()->accept(*this);
+        Speculated = Saved;
+        V = And ? Builder.CreateSelect(Left, V, Int1False) : Builder.CreateSelect(Left, Int1True, V);
+        return;
       }
+
+      // Otherwise it only runs if the left one leaves the result open.
+      Function *Fn = Builder.GetInsertBlock()->getParent();
+      BasicBlock *LeftBB = Builder.GetInsertBlock();
+      BasicBlock *RightBB = BasicBlock::Create(M->getContext(), And ? "and.rhs" : "or.rhs", Fn);
+      BasicBlock *AfterBB = BasicBlock::Create(M->getContext(), And ? "after.and" : "after.or", Fn);
+      if (And)
+        Builder.CreateCondBr(Left, RightBB, AfterBB);
+      else
+        Builder.CreateCondBr(Left, AfterBB, RightBB);
+      sealBlock(RightBB);
+
+      Builder.SetInsertPoint(RightBB);
+      Node.getRight()->accept(*this);
+      Value *Right = V;
+      BasicBlock *RightEndBB = Builder.GetInsertBlock();
+      Builder.CreateBr(AfterBB);
+      sealBlock(AfterBB);
+
+      Builder.SetInsertPoint(AfterBB);
+      PHINode *Result = Builder.CreatePHI(Int1Ty, 2);
+      Result->addIncoming(And ? Int1False : Int1True, LeftBB);
+      Result->addIncoming(Right, RightEndBB);
+      V = Result;
     };
 
     virtual void visit(Comparison &Node) override{
@@ -371,12 +802,7 @@ ns{
           V = Int1False;
           break;
         case Comparison::Ident: 
-          if(isBool(((Final*)Node.getLeft())->getVal())){
-            V = Builder.CreateLoad(Int1Ty, nameMapBool[((Final*)Node.getLeft())->getVal()]);
-            break;
-          }
-          
-          V = Builder.CreateLoad(Int32Ty, nameMapInt[((Final*)Node.getLeft())->getVal()]);
+          V = loadSlot(((Final*)Node.getLeft())->getRef());
           break;
         
         default:
@@ -416,20 +842,182 @@ ns{
       }
     };
 
-    bool isBool(llvm::StringRef Var)
+    // Returns the storage for a declared variable in the slot Sema assigned to it.
+    // Sema hands the slots of ended scopes to later declarations, so a slot is
+    // allocated once in the entry block, where it dominates all of its users.
+    Value *createSlot(VarRef Ref)
     {
-      return nameMapBool.find(Var) != nameMapBool.end();
+      if (SSA)
+        return nullptr;
+      SmallVector<Value *> &Slots = Ref.isBool() ? BoolSlots : IntSlots;
+      if (Slots.size() <= Ref.getSlot())
+        Slots.resize(Ref.getSlot() + 1, nullptr);
+      if (!Slots[Ref.getSlot()])
+        Slots[Ref.getSlot()] = StateInts ? createStateSlot(Ref) : createEntryAlloca(Ref.isBool() ? Int1Ty : Int32Ty);
+      return Slots[Ref.getSlot()];
+    }
+
+    // Allocates stack space in the entry block of the current function. An
+    // alloca anywhere else would take more stack each time it runs, and
+    // mem2reg only promotes the ones in the entry block.
+    AllocaInst *createEntryAlloca(Type *Ty)
+    {
+      BasicBlock &Entry = Builder.GetInsertBlock()->getParent()->getEntryBlock();
+      return IRBuilder<>(&Entry, Entry.begin()).CreateAlloca(Ty);
+    }
+
+    // Returns the storage of a variable resolved by Sema.
+    Value *getSlot(VarRef Ref)
+    {
+      SmallVector<Value *> &Slots = Ref.isBool() ? BoolSlots : IntSlots;
+      if (StateInts && (Slots.size() <= Ref.getSlot() || !Slots[Ref.getSlot()]))
+        return createSlot(Ref);
+      return Slots[Ref.getSlot()];
+    }
+
+    // Allocates the slot of a variable for runLoop, loaded from the arrays
+    // the loop is entered with. A variable declared in the loop gets one too,
+    // which its declaration overwrites.
+    AllocaInst *createStateSlot(VarRef Ref)
+    {
+      Type *Ty = Ref.isBool() ? Int1Ty : Int32Ty;
+      AllocaInst *Slot = createEntryAlloca(Ty);
+      IRBuilder<> Entry(Slot->getParent(), std::next(Slot->getIterator()));
+      Value *State = Ref.isBool() ? StateBools : StateInts;
+      Entry.CreateStore(Entry.CreateLoad(Ty, Entry.CreateConstGEP1_32(Ty, State, Ref.getSlot())), Slot);
+      StateSlots.push_back({Ref, Slot});
+      return Slot;
+    }
+
+    Value *loadSlot(VarRef Ref)
+    {
+      if (SSA)
+        return readVariable(Ref.getSlot() * 2 + Ref.isBool(), Builder.GetInsertBlock());
+      return Builder.CreateLoad(Ref.isBool() ? Int1Ty : Int32Ty, getSlot(Ref));
+    }
+
+    void storeSlot(VarRef Ref, Value *Val)
+    {
+      if (SSA)
+        CurrentDef[{Ref.getSlot() * 2 + Ref.isBool(), Builder.GetInsertBlock()}] = Val;
+      else
+        Builder.CreateStore(Val, getSlot(Ref));
+    }
+
+    // Returns the value variable Var has at the end of BB, looking through
+    // the predecessors of BB if it is not assigned there.
+    Value *readVariable(unsigned Var, BasicBlock *BB)
+    {
+      DenseMap<std::pair<unsigned, BasicBlock *>, Value *>::iterator I = CurrentDef.find({Var, BB});
+      if (I != CurrentDef.end())
+        return I->second = resolve(I->second);
+
+      Value *Val;
+      if (!Sealed.count(BB))
+      {
+        // More predecessors may come; the phi gets its operands when they did
+        PHINode *Phi = createPhi(Var, BB);
+        IncompletePhis[BB].push_back({Var, Phi});
+        Val = Phi;
+      }
+      else if (BasicBlock *Pred = BB->getSinglePredecessor())
+        Val = readVariable(Var, Pred);
+      else if (pred_empty(BB))
+        // Read before any assignment, which DeadInit allows when no path does so
+        Val = UndefValue::get(Var & 1 ? Int1Ty : Int32Ty);
+      else
+      {
+        // The phi is the value of Var in BB while its operands are read, which
+        // ends the search around loops
+        PHINode *Phi = createPhi(Var, BB);
+        CurrentDef[{Var, BB}] = Phi;
+        Val = addPhiOperands(Var, Phi);
+      }
+      CurrentDef[{Var, BB}] = Val;
+      return Val;
+    }
+
+    PHINode *createPhi(unsigned Var, BasicBlock *BB)
+    {
+      Type *Ty = Var & 1 ? Int1Ty : Int32Ty;
+      PHINode *Phi = BB->getFirstNonPHI() ? PHINode::Create(Ty, 2, "", BB->getFirstNonPHI()) : PHINode::Create(Ty, 2, "", BB);
+      Incomplete.insert(Phi);
+      return Phi;
+    }
+
+    Value *addPhiOperands(unsigned Var, PHINode *Phi)
+    {
+      for (BasicBlock *Pred : predecessors(Phi->getParent()))
+        Phi->addIncoming(readVariable(Var, Pred), Pred);
+      Incomplete.erase(Phi);
+      return tryRemoveTrivialPhi(Phi);
+    }
+
+    // Replaces a phi that only merges one value, besides itself, by that
+    // value. Phis using it may become trivial in turn.
+    Value *tryRemoveTrivialPhi(PHINode *Phi)
+    {
+      Value *Same = nullptr;
+      for (Value *Op : Phi->incoming_values())
+      {
+        if (Op == Same || Op == Phi)
+          continue;
+        if (Same)
+          return Phi;
+        Same = Op;
+      }
+      if (!Same)
+        Same = UndefValue::get(Phi->getType());
+
+      SmallVector<PHINode *, 4> Users;
+      for (User *U : Phi->users())
+        if (U != Phi && isa<PHINode>(U))
+          Users.push_back(cast<PHINode>(U));
+      Phi->replaceAllUsesWith(Same);
+      Phi->removeFromParent();
+      Replaced[Phi] = Same;
+      for (PHINode *UserPhi : Users)
+        if (UserPhi->getParent() && !Incomplete.count(UserPhi))
+          tryRemoveTrivialPhi(UserPhi);
+      return resolve(Same);
+    }
+
+    // Follows the replacements of removed phis
+    Value *resolve(Value *Val)
+    {
+      while (PHINode *Phi = dyn_cast<PHINode>(Val))
+      {
+        if (Phi->getParent())
+          break;
+        Val = Replaced[Phi];
+      }
+      return Val;
+    }
+
+    // Notes that all predecessors of BB have their branches, completing the
+    // phis created for reads in BB before.
+    void sealBlock(BasicBlock *BB)
+    {
+      if (!SSA)
+        return;
+      Sealed.insert(BB);
+      DenseMap<BasicBlock *, SmallVector<std::pair<unsigned, PHINode *>, 4>>::iterator I = IncompletePhis.find(BB);
+      if (I == IncompletePhis.end())
+        return;
+      SmallVector<std::pair<unsigned, PHINode *>, 4> Phis = std::move(I->second);
+      IncompletePhis.erase(I);
+      for (std::pair<unsigned, PHINode *> P : Phis)
+        addPhiOperands(P.first, P.second);
     }
 
     virtual void visit(PrintStmt &Node) override
     {
       // Visit the right-hand side of the assignment and get its value.
-      if (isBool(Node.getVar())){
-        V = Builder.CreateLoad(Int1Ty, nameMapBool[Node.getVar()]);
+      V = loadSlot(Node.getRef());
+      if (Node.getRef().isBool()){
         CallInst *Call = Builder.CreateCall(PrintBoolFnTy, PrintBoolFn, {V});
       }
       else{
-        V = Builder.CreateLoad(Int32Ty, nameMapInt[Node.getVar()]);
         CallInst *Call = Builder.CreateCall(PrintIntFnTy, PrintIntFn, {V});
       }      
     };
@@ -445,6 +1033,8 @@ ns{
       Node.getCond()->accept(*this);
       Value* val=V;
       Builder.CreateCondBr(val, WhileBodyBB, AfterWhileBB);
+      sealBlock(WhileBodyBB);
+      sealBlock(AfterWhileBB);
       Builder.SetInsertPoint(WhileBodyBB);
 
       for (llvm::SmallVector<AST* >::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
@@ -453,6 +1043,7 @@ ns{
         }
 
       Builder.CreateBr(WhileCondBB);
+      sealBlock(WhileCondBB);
 
       Builder.SetInsertPoint(AfterWhileBB);
         
@@ -460,11 +1051,15 @@ ns{
 
     virtual void visit(ForStmt &Node) override
     {
+      if (Node.getSharing().Parallel && !Outlined)
+        return emitParallelFor(Node);
+
       llvm::BasicBlock* ForCondBB = llvm::BasicBlock::Create(M->getContext(), "for.cond", Builder.GetInsertBlock()->getParent());
       llvm::BasicBlock* ForBodyBB = llvm::BasicBlock::Create(M->getContext(), "for.body", Builder.GetInsertBlock()->getParent());
       llvm::BasicBlock* AfterForBB = llvm::BasicBlock::Create(M->getContext(), "after.for", Builder.GetInsertBlock()->getParent());
 
-      Node.getFirst()->accept(*this);
+      if (&Node != Resumed)
+        Node.getFirst()->accept(*this);
 
       Builder.CreateBr(ForCondBB); //?
 
@@ -472,8 +1067,12 @@ ns{
       Node.getSecond()->accept(*this);
       Value* val=V;
       Builder.CreateCondBr(val, ForBodyBB, AfterForBB);
+      sealBlock(ForBodyBB);
+      sealBlock(AfterForBB);
 
       Builder.SetInsertPoint(ForBodyBB);
+      assumeBodyRange(Node);
+
       for (llvm::SmallVector<AST* >::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
         {
             (*I)->accept(*this);
@@ -485,70 +1084,344 @@ ns{
         Node.getThirdAssign()->accept(*this);
 
       Builder.CreateBr(ForCondBB);
+      sealBlock(ForCondBB);
 
       Builder.SetInsertPoint(AfterForBB);
     };
 
-    virtual void visit(IfStmt &Node) override{
-      llvm::BasicBlock* IfCondBB = llvm::BasicBlock::Create(M->getContext(), "if.cond", Builder.GetInsertBlock()->getParent());
-      llvm::BasicBlock* IfBodyBB = llvm::BasicBlock::Create(M->getContext(), "if.body", Builder.GetInsertBlock()->getParent());
+    // Lowers an if/else-if chain whose conditions all compare the same int
+    // variable with literals to one switch, so LLVM can dispatch with a jump
+    // table or a binary search instead of testing every condition in turn.
+    // Returns false if the chain has another shape.
+    bool lowerToSwitch(IfStmt &Node)
+    {
+      if (Node.beginElif() == Node.endElif())
+        return false;
+
+      CaseTest Test;
+      Final *Var;
+      int32_t Literal;
+      llvm::SmallVector<int32_t, 8> Values;
+      if (!Test.match(Node.getCond(), Var, Literal))
+        return false;
+      VarRef Ref = Var->getRef();
+      Values.push_back(Literal);
+      for (llvm::SmallVector<elifStmt *, 8>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      {
+        Final *ElifVar;
+        if (!Test.match((*I)->getCond(), ElifVar, Literal) || ElifVar->getRef().getSlot() != Ref.getSlot())
+          return false;
+        Values.push_back(Literal);
+      }
+
+      Var->accept(*this);
+      Value *Scrutinee = V;
       llvm::BasicBlock* AfterIfBB = llvm::BasicBlock::Create(M->getContext(), "after.if", Builder.GetInsertBlock()->getParent());
+      llvm::BasicBlock* DefaultBB = AfterIfBB;
+      if (Node.beginElse() != Node.endElse())
+        DefaultBB = llvm::BasicBlock::Create(M->getContext(), "else.body", Builder.GetInsertBlock()->getParent(), AfterIfBB);
+      SwitchInst *Switch = Builder.CreateSwitch(Scrutinee, DefaultBB, Values.size());
+      if (DefaultBB != AfterIfBB)
+        sealBlock(DefaultBB);
+
+      // A literal tested again further down the chain never selects that body
+      for (unsigned I = 0, E = Values.size(); I != E; ++I)
+      {
+        ConstantInt *Case = ConstantInt::get((IntegerType *)Int32Ty, Values[I], true);
+        if (Switch->findCaseValue(Case) != Switch->case_default())
+          continue;
+        llvm::BasicBlock* BodyBB = llvm::BasicBlock::Create(M->getContext(), I == 0 ? "if.body" : "elif.body", Builder.GetInsertBlock()->getParent(), DefaultBB);
+        Switch->addCase(Case, BodyBB);
+        sealBlock(BodyBB);
+        Builder.SetInsertPoint(BodyBB);
+        if (I == 0)
+          for (llvm::SmallVector<AST* >::const_iterator B = Node.begin(), BE = Node.end(); B != BE; ++B)
+            (*B)->accept(*this);
+        else
+          Node.getElifs()[I - 1]->accept(*this);
+        Builder.CreateBr(AfterIfBB);
+      }
 
-      Builder.CreateBr(IfCondBB); //?
-      Builder.SetInsertPoint(IfCondBB);
-      Node.getCond()->accept(*this);
-      Value* IfCondVal=V;
+      if (DefaultBB != AfterIfBB)
+      {
+        Builder.SetInsertPoint(DefaultBB);
+        for (llvm::SmallVector<AST* >::const_iterator I = Node.beginElse(), E = Node.endElse(); I != E; ++I)
+          (*I)->accept(*this);
+        Builder.CreateBr(AfterIfBB);
+      }
 
-      Builder.SetInsertPoint(IfBodyBB);
+      sealBlock(AfterIfBB);
+      Builder.SetInsertPoint(AfterIfBB);
+      return true;
+    }
 
-      for (llvm::SmallVector<AST* >::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+    // Tells LLVM the values the induction variable has in the body.
+    void assumeBodyRange(ForStmt &Node)
+    {
+      ValueRange Range = Node.getBodyRange();
+      if (Range.isKnown())
+      {
+        Value *IndVar = loadSlot(Node.getFirst()->getLeft()->getRef());
+        if (Range.getLo() != INT32_MIN)
+          Builder.CreateAssumption(Builder.CreateICmpSGE(IndVar, ConstantInt::get(Int32Ty, Range.getLo(), true)));
+        if (Range.getHi() != INT32_MAX)
+          Builder.CreateAssumption(Builder.CreateICmpSLE(IndVar, ConstantInt::get(Int32Ty, Range.getHi(), true)));
+      }
+    }
+
+    // Whether Ref is a sum or a product of the loop being outlined
+    bool isPartial(VarRef Ref)
+    {
+      if (!Outlined)
+        return false;
+      LoopSharing &Sharing = Outlined->getSharing();
+      for (VarRef R : Sharing.Sums)
+        if (R.getSlot() == Ref.getSlot() && R.isBool() == Ref.isBool())
+          return true;
+      for (VarRef R : Sharing.Products)
+        if (R.getSlot() == Ref.getSlot() && R.isBool() == Ref.isBool())
+          return true;
+      return false;
+    }
+
+    // Returns the number of iterations of a loop ParallelLoops marked, which
+    // starts at Start and counts towards Bound, as a 64-bit value.
+    Value *tripCount(LoopSharing &Sharing, Value *Start, Value *Bound)
+    {
+      Value *From = Builder.CreateSExt(Start, Int64Ty);
+      Value *To = Builder.CreateSExt(Bound, Int64Ty);
+      Value *Distance = Sharing.Step > 0 ? Builder.CreateSub(To, From) : Builder.CreateSub(From, To);
+      Constant *Stride = ConstantInt::get(Int64Ty, Sharing.Step > 0 ? (int64_t)Sharing.Step : -(int64_t)Sharing.Step);
+      Constant *Zero = ConstantInt::get(Int64Ty, 0);
+      if (Sharing.Op == Comparison::Less_equal || Sharing.Op == Comparison::Greater_equal)
+        return Builder.CreateSelect(Builder.CreateICmpSGE(Distance, Zero),
+                                    Builder.CreateAdd(Builder.CreateSDiv(Distance, Stride), ConstantInt::get(Int64Ty, 1)), Zero);
+      return Builder.CreateSelect(Builder.CreateICmpSGT(Distance, Zero),
+                                  Builder.CreateSDiv(Builder.CreateAdd(Distance, ConstantInt::get(Int64Ty, Sharing.Step > 0 ? Sharing.Step - 1 : -(int64_t)Sharing.Step - 1)), Stride), Zero);
+    }
+
+    // Runs a loop ParallelLoops marked by handing its iterations to par_for
+    // of the runtime, which splits them into one block per thread. The body
+    // is outlined into a function that runs a block of iterations with its
+    // own copy of every variable. The variables are passed in an array of
+    // pointers: the induction variable, then the shared, private, sum and
+    // product ones.
+    void emitParallelFor(ForStmt &Node)
+    {
+      LoopSharing &Sharing = Node.getSharing();
+      VarRef IndVar = Node.getFirst()->getLeft()->getRef();
+      if (&Node != Resumed)
+        Node.getFirst()->accept(*this);
+      Value *Start = loadSlot(IndVar);
+      Sharing.Bound->accept(*this);
+      Value *Trips = tripCount(Sharing, Start, V);
+
+      SmallVector<VarRef, 8> Vars;
+      Vars.push_back(IndVar);
+      Vars.append(Sharing.Shared.begin(), Sharing.Shared.end());
+      Vars.append(Sharing.Private.begin(), Sharing.Private.end());
+      Vars.append(Sharing.Sums.begin(), Sharing.Sums.end());
+      Vars.append(Sharing.Products.begin(), Sharing.Products.end());
+
+      // In SSA mode the variables are copied to stack slots for the call and
+      // the ones the loop writes are read back after it
+      ArrayType *ContextTy = ArrayType::get(Int8PtrTy, Vars.size());
+      AllocaInst *Context = createEntryAlloca(ContextTy);
+      SmallVector<Value *, 8> Addrs;
+      for (unsigned I = 0, E = Vars.size(); I != E; ++I)
+      {
+        Value *Addr = createSlot(Vars[I]);
+        if (SSA)
         {
-            (*I)->accept(*this);
+          Addr = createEntryAlloca(Vars[I].isBool() ? Int1Ty : Int32Ty);
+          Builder.CreateStore(loadSlot(Vars[I]), Addr);
         }
+        Addrs.push_back(Addr);
+        Builder.CreateStore(Builder.CreateBitCast(Addr, Int8PtrTy), Builder.CreateConstGEP2_32(ContextTy, Context, 0, I));
+      }
 
-      Builder.CreateBr(AfterIfBB);
+      Function *BodyFn = outlineBody(Node, Vars);
+      FunctionCallee ParFor = M->getOrInsertFunction("par_for", VoidTy, BodyFn->getType(), Int8PtrTy, Int64Ty, Int64Ty);
+      Builder.CreateCall(ParFor, {BodyFn, Builder.CreateBitCast(Context, Int8PtrTy), Trips, ConstantInt::get(Int64Ty, Sharing.MinTrips)});
+      if (SSA)
+        for (unsigned I = 1 + Sharing.Shared.size(), E = Vars.size(); I != E; ++I)
+          storeSlot(Vars[I], Builder.CreateLoad(Vars[I].isBool() ? Int1Ty : Int32Ty, Addrs[I]));
 
-      llvm::BasicBlock* PreviousCondBB = IfCondBB;
-      llvm::BasicBlock* PreviousBodyBB = IfBodyBB;
-      Value* PreviousCondVal = IfCondVal;
+      // The induction variable ends at the first value that fails the condition
+      Value *Counted = Builder.CreateMul(Builder.CreateTrunc(Trips, Int32Ty), ConstantInt::get(Int32Ty, Sharing.Step, true));
+      storeSlot(IndVar, Builder.CreateAdd(Start, Counted));
+    }
 
+    // Creates `void (i8 *Context, i64 Begin, i64 End, i32 Last)` running the
+    // iterations from Begin up to End of a loop ParallelLoops marked. The
+    // block that ends with the last iteration stores the private variables
+    // back; every block adds its partial sums and products to the shared ones.
+    Function *outlineBody(ForStmt &Node, SmallVector<VarRef, 8> &Vars)
+    {
+      LoopSharing &Sharing = Node.getSharing();
+      FunctionType *BodyFnTy = FunctionType::get(VoidTy, {Int8PtrTy, Int64Ty, Int64Ty, Int32Ty}, false);
+      Function *Fn = Function::Create(BodyFnTy, GlobalValue::InternalLinkage, "main.for.body", M);
+      Argument *ContextArg = Fn->getArg(0), *Begin = Fn->getArg(1), *End = Fn->getArg(2), *Last = Fn->getArg(3);
+
+      IRBuilderBase::InsertPoint SavedIP = Builder.saveIP();
+      SmallVector<Value *> SavedInt, SavedBool;
+      std::swap(IntSlots, SavedInt);
+      std::swap(BoolSlots, SavedBool);
+      Value *SavedStateInts = StateInts, *SavedStateBools = StateBools;
+      StateInts = StateBools = nullptr;
+      Outlined = &Node;
+
+      BasicBlock *EntryBB = BasicBlock::Create(M->getContext(), "entry", Fn);
+      Builder.SetInsertPoint(EntryBB);
+      sealBlock(EntryBB);
+      ArrayType *ContextTy = ArrayType::get(Int8PtrTy, Vars.size());
+      Value *Context = Builder.CreateBitCast(ContextArg, ContextTy->getPointerTo());
+      SmallVector<Value *, 8> SharedPtrs;
+      for (unsigned I = 0, E = Vars.size(); I != E; ++I)
+      {
+        Value *Ptr = Builder.CreateLoad(Int8PtrTy, Builder.CreateConstGEP2_32(ContextTy, Context, 0, I));
+        SharedPtrs.push_back(Builder.CreateBitCast(Ptr, (Vars[I].isBool() ? Int1Ty : Int32Ty)->getPointerTo()));
+        createSlot(Vars[I]);
+      }
+
+      unsigned FirstPrivate = 1 + Sharing.Shared.size();
+      unsigned FirstSum = FirstPrivate + Sharing.Private.size();
+      unsigned FirstProduct = FirstSum + Sharing.Sums.size();
+      Value *Start = Builder.CreateLoad(Int32Ty, SharedPtrs[0]);
+      for (unsigned I = 1; I != FirstPrivate; ++I)
+        storeSlot(Vars[I], Builder.CreateLoad(Vars[I].isBool() ? Int1Ty : Int32Ty, SharedPtrs[I]));
+      for (unsigned I = FirstSum; I != Vars.size(); ++I)
+        storeSlot(Vars[I], I < FirstProduct ? Int32Zero : Int32One);
+
+      BasicBlock *CondBB = BasicBlock::Create(M->getContext(), "for.cond", Fn);
+      BasicBlock *BodyBB = BasicBlock::Create(M->getContext(), "for.body", Fn);
+      BasicBlock *AfterBB = BasicBlock::Create(M->getContext(), "after.for", Fn);
+      Builder.CreateBr(CondBB);
+      Builder.SetInsertPoint(CondBB);
+      PHINode *K = Builder.CreatePHI(Int64Ty, 2);
+      K->addIncoming(Begin, EntryBB);
+      Builder.CreateCondBr(Builder.CreateICmpSLT(K, End), BodyBB, AfterBB);
+      sealBlock(BodyBB);
+      sealBlock(AfterBB);
+
+      Builder.SetInsertPoint(BodyBB);
+      Value *Offset = Builder.CreateMul(Builder.CreateTrunc(K, Int32Ty), ConstantInt::get(Int32Ty, Sharing.Step, true));
+      storeSlot(Vars[0], Builder.CreateAdd(Start, Offset));
+      assumeBodyRange(Node);
+      for (llvm::SmallVector<AST* >::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+        (*I)->accept(*this);
+      K->addIncoming(Builder.CreateAdd(K, ConstantInt::get(Int64Ty, 1)), Builder.GetInsertBlock());
+      Builder.CreateBr(CondBB);
+      sealBlock(CondBB);
+
+      Builder.SetInsertPoint(AfterBB);
+      for (unsigned I = FirstSum; I != FirstProduct; ++I)
+        Builder.CreateAtomicRMW(AtomicRMWInst::Add, SharedPtrs[I], loadSlot(Vars[I]), MaybeAlign(4), AtomicOrdering::Monotonic);
+      for (unsigned I = FirstProduct; I != Vars.size(); ++I)
+      {
+        // There is no atomic multiplication, so retry until no other block
+        // changed the product in between
+        Value *Partial = loadSlot(Vars[I]);
+        Value *Old = Builder.CreateLoad(Int32Ty, SharedPtrs[I]);
+        BasicBlock *Before = Builder.GetInsertBlock();
+        BasicBlock *RetryBB = BasicBlock::Create(M->getContext(), "product.retry", Fn);
+        BasicBlock *DoneBB = BasicBlock::Create(M->getContext(), "product.done", Fn);
+        Builder.CreateBr(RetryBB);
+        Builder.SetInsertPoint(RetryBB);
+        PHINode *Seen = Builder.CreatePHI(Int32Ty, 2);
+        Seen->addIncoming(Old, Before);
+        Value *Pair = Builder.CreateAtomicCmpXchg(SharedPtrs[I], Seen, Builder.CreateMul(Seen, Partial), MaybeAlign(4),
+                                                  AtomicOrdering::Monotonic, AtomicOrdering::Monotonic);
+        Seen->addIncoming(Builder.CreateExtractValue(Pair, 0), RetryBB);
+        Builder.CreateCondBr(Builder.CreateExtractValue(Pair, 1), DoneBB, RetryBB);
+        sealBlock(RetryBB);
+        sealBlock(DoneBB);
+        Builder.SetInsertPoint(DoneBB);
+      }
+      BasicBlock *WriteBackBB = BasicBlock::Create(M->getContext(), "last.block", Fn);
+      BasicBlock *RetBB = BasicBlock::Create(M->getContext(), "return", Fn);
+      Builder.CreateCondBr(Builder.CreateICmpNE(Last, Int32Zero), WriteBackBB, RetBB);
+      sealBlock(WriteBackBB);
+      Builder.SetInsertPoint(WriteBackBB);
+      for (unsigned I = FirstPrivate; I != FirstSum; ++I)
+        Builder.CreateStore(loadSlot(Vars[I]), SharedPtrs[I]);
+      Builder.CreateBr(RetBB);
+      sealBlock(RetBB);
+      Builder.SetInsertPoint(RetBB);
+      Builder.CreateRetVoid();
+
+      Outlined = nullptr;
+      StateInts = SavedStateInts;
+      StateBools = SavedStateBools;
+      std::swap(IntSlots, SavedInt);
+      std::swap(BoolSlots, SavedBool);
+      Builder.restoreIP(SavedIP);
+      return Fn;
+    }
+
+    virtual void visit(IfStmt &Node) override{
+      if (lowerToSwitch(Node))
+        return;
+
+      llvm::BasicBlock* IfCondBB = llvm::BasicBlock::Create(M->getContext(), "if.cond", Builder.GetInsertBlock()->getParent());
+      llvm::BasicBlock* IfBodyBB = llvm::BasicBlock::Create(M->getContext(), "if.body", Builder.GetInsertBlock()->getParent());
+      llvm::BasicBlock* AfterIfBB = llvm::BasicBlock::Create(M->getContext(), "after.if", Builder.GetInsertBlock()->getParent());
+      llvm::BasicBlock* ElseBB = AfterIfBB;
+      if (Node.beginElse() != Node.endElse())
+        ElseBB = llvm::BasicBlock::Create(M->getContext(), "else.body", Builder.GetInsertBlock()->getParent());
+
+      Builder.CreateBr(IfCondBB); //?
+      sealBlock(IfCondBB);
+      Builder.SetInsertPoint(IfCondBB);
+
+      // The conditions are tested first, each branching to its body or to the
+      // next test, so every body has its predecessor when it is generated. A
+      // condition may end in another block than it began, after an
+      // exponentiation or a short-circuit 'and'/'or'.
+      SmallVector<BasicBlock *, 8> BodyBBs;
+      BodyBBs.push_back(IfBodyBB);
+      Node.getCond()->accept(*this);
       for (llvm::SmallVector<elifStmt *, 8>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
       {
         llvm::BasicBlock* ElifCondBB = llvm::BasicBlock::Create(M->getContext(), "elif.cond", Builder.GetInsertBlock()->getParent());
         llvm::BasicBlock* ElifBodyBB = llvm::BasicBlock::Create(M->getContext(), "elif.body", Builder.GetInsertBlock()->getParent());
 
-        Builder.SetInsertPoint(PreviousCondBB);
-        Builder.CreateCondBr(PreviousCondVal, PreviousBodyBB, ElifCondBB);
-
+        Builder.CreateCondBr(V, BodyBBs.back(), ElifCondBB);
+        sealBlock(BodyBBs.back());
+        sealBlock(ElifCondBB);
         Builder.SetInsertPoint(ElifCondBB);
         (*I)->getCond()->accept(*this);
-        Value* ElifCondVal = V;
+        BodyBBs.push_back(ElifBodyBB);
+      }
+      Builder.CreateCondBr(V, BodyBBs.back(), ElseBB);
+      sealBlock(BodyBBs.back());
+      if (ElseBB != AfterIfBB)
+        sealBlock(ElseBB);
 
-        Builder.SetInsertPoint(ElifBodyBB);
-        (*I)->accept(*this);
-        Builder.CreateBr(AfterIfBB);
+      Builder.SetInsertPoint(IfBodyBB);
+      for (llvm::SmallVector<AST* >::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+        {
+            (*I)->accept(*this);
+        }
+      Builder.CreateBr(AfterIfBB);
 
-        PreviousCondBB = ElifCondBB;
-        PreviousCondVal = ElifCondVal;
-        PreviousBodyBB = ElifBodyBB;
+      for (unsigned I = 1, E = BodyBBs.size(); I != E; ++I)
+      {
+        Builder.SetInsertPoint(BodyBBs[I]);
+        Node.getElifs()[I - 1]->accept(*this);
+        Builder.CreateBr(AfterIfBB);
       }
-      if (Node.beginElse() != Node.endElse()) {
-        llvm::BasicBlock* ElseBB = llvm::BasicBlock::Create(M->getContext(), "else.body", Builder.GetInsertBlock()->getParent());
+
+      if (ElseBB != AfterIfBB) {
         Builder.SetInsertPoint(ElseBB);
         for (llvm::SmallVector<AST* >::const_iterator I = Node.beginElse(), E = Node.endElse(); I != E; ++I)
         {
             (*I)->accept(*this);
         }
         Builder.CreateBr(AfterIfBB);
-
-        Builder.SetInsertPoint(PreviousCondBB);
-        Builder.CreateCondBr(PreviousCondVal, PreviousBodyBB, ElseBB);
-      }
-      else {
-        Builder.SetInsertPoint(PreviousCondBB);
-        Builder.CreateCondBr(IfCondVal, PreviousBodyBB, AfterIfBB);
       }
 
+      sealBlock(AfterIfBB);
       Builder.SetInsertPoint(AfterIfBB);
     };
 
@@ -558,21 +1431,313 @@ ns{
             (*I)->accept(*this);
         }
     };
+
+    // Lowers a switch to one SwitchInst, leaving the choice of dispatch to
+    // LLVM: a jump table for dense labels, a balanced tree of comparisons for
+    // sparse ones. Each arm gets a block, in source order, that falls through
+    // to the block of the next arm.
+    virtual void visit(SwitchStmt &Node) override{
+      Node.getCond()->accept(*this);
+      Value *Scrutinee = V;
+
+      llvm::BasicBlock* AfterSwitchBB = llvm::BasicBlock::Create(M->getContext(), "after.switch", Builder.GetInsertBlock()->getParent());
+      llvm::BasicBlock* DefaultBB = AfterSwitchBB;
+      SmallVector<BasicBlock *, 8> ArmBBs;
+      for (CaseStmt *C : Node.getCases())
+      {
+        ArmBBs.push_back(llvm::BasicBlock::Create(M->getContext(), C->isDefault() ? "default.body" : "case.body", Builder.GetInsertBlock()->getParent(), AfterSwitchBB));
+        if (C->isDefault())
+          DefaultBB = ArmBBs.back();
+      }
+
+      SwitchInst *Switch = Builder.CreateSwitch(Scrutinee, DefaultBB, ArmBBs.size());
+      for (unsigned I = 0, E = ArmBBs.size(); I != E; ++I)
+        if (!Node.getCases()[I]->isDefault())
+          Switch->addCase(ConstantInt::get((IntegerType *)Int32Ty, Node.getCases()[I]->getLiteral(), true), ArmBBs[I]);
+
+      // An arm is entered from the switch and from the end of the arm before
+      // it, so its block is sealed once that arm has been generated
+      sealBlock(ArmBBs[0]);
+      for (unsigned I = 0, E = ArmBBs.size(); I != E; ++I)
+      {
+        Builder.SetInsertPoint(ArmBBs[I]);
+        Node.getCases()[I]->accept(*this);
+        if (I + 1 != E)
+        {
+          Builder.CreateBr(ArmBBs[I + 1]);
+          sealBlock(ArmBBs[I + 1]);
+        }
+        else
+          Builder.CreateBr(AfterSwitchBB);
+      }
+
+      sealBlock(AfterSwitchBB);
+      Builder.SetInsertPoint(AfterSwitchBB);
+    };
+
+    virtual void visit(CaseStmt &Node) override{
+      for (llvm::SmallVector<AST* >::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+        (*I)->accept(*this);
+    };
   };
 }; // namespace
 
-void CodeGen::compile(Program *Tree)
+ChunkCodeGen::ChunkCodeGen() : M(new Module("simple-compiler", Ctx)), ToIR(new ns::ToIRVisitor(M.get())) {}
+
+ChunkCodeGen::~ChunkCodeGen() = default;
+
+std::string ChunkCodeGen::emit(AST *Stmt, llvm::StringRef Name, llvm::ArrayRef<std::pair<llvm::StringRef, VarRef>> Globals)
+{
+  Function *Fn = ToIR->runStatement(Stmt, Name, Globals);
+  std::string Text;
+  raw_string_ostream OS(Text);
+  Fn->print(OS);
+  Fn->eraseFromParent();
+
+  // A variable may have another type in the next program
+  while (!M->global_empty())
+    M->global_begin()->eraseFromParent();
+  return OS.str();
+}
+
+void ChunkCodeGen::printModule(llvm::raw_ostream &OS, llvm::ArrayRef<std::pair<llvm::StringRef, VarRef>> Globals,
+                               llvm::ArrayRef<llvm::StringRef> Functions, llvm::ArrayRef<llvm::StringRef> Calls)
+{
+  OS << "; ModuleID = 'simple-compiler'\nsource_filename = \"simple-compiler\"\n\n";
+  for (std::pair<llvm::StringRef, VarRef> G : Globals)
+    OS << "@v." << G.first << " = internal global " << (G.second.isBool() ? "i1 false" : "i32 0") << "\n";
+  OS << "\ndeclare void @print_int(i32)\n\ndeclare void @print_bool(i1)\n\n";
+  for (llvm::StringRef F : Functions)
+    OS << F << "\n";
+  OS << "define i32 @main(i32 %0, i8** %1) {\nentry:\n";
+  for (llvm::StringRef C : Calls)
+    OS << "  call void @" << C << "()\n";
+  OS << "  ret i32 0\n}\n";
+}
+
+// Creates the TargetMachine of the host. It makes the code llc makes by
+// default, for any CPU of the host's architecture, with more optimization
+// for -O3.
+static std::unique_ptr<TargetMachine> createHostMachine(unsigned OptLevel, std::string &Error)
+{
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  std::string Triple = sys::getDefaultTargetTriple();
+  const Target *T = TargetRegistry::lookupTarget(Triple, Error);
+  if (!T)
+    return nullptr;
+
+  // PIC objects link into the position independent executables compilers
+  // build by default
+  return std::unique_ptr<TargetMachine>(T->createTargetMachine(Triple, "generic", "", TargetOptions(), Reloc::PIC_, None,
+                                                               OptLevel == 3 ? CodeGenOpt::Aggressive : CodeGenOpt::Default));
+}
+
+// Runs the default pipeline of an optimization level on the module, with the
+// costs of the target if there is one.
+static void optimize(Module *M, unsigned OptLevel, TargetMachine *TM)
+{
+  static const OptimizationLevel Levels[] = {OptimizationLevel::O0, OptimizationLevel::O1, OptimizationLevel::O2, OptimizationLevel::O3,
+                                             OptimizationLevel::Os};
+  if (OptLevel == 0)
+    return;
+
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB(TM);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(Levels[OptLevel]);
+  MPM.run(*M, MAM);
+}
+
+bool CodeGen::emit(orc::ThreadSafeModule TSM, unsigned OptLevel)
+{
+  Module *M = TSM.getModuleUnlocked();
+
+  // IR is still written when there is no target for the host
+  std::string Error;
+  std::unique_ptr<TargetMachine> TM = createHostMachine(OptLevel, Error);
+  if (TM)
+  {
+    M->setTargetTriple(TM->getTargetTriple().str());
+    M->setDataLayout(TM->createDataLayout());
+  }
+  else if (Type != IR && Type != Bitcode)
+  {
+    errs() << "Cannot emit code for the host: " << Error << "\n";
+    return true;
+  }
+  optimize(M, OptLevel, TM.get());
+
+  if (Type == JIT)
+    return run(std::move(TSM), OptLevel);
+
+  if (Type == IR)
+  {
+    M->print(Out, nullptr);
+    return false;
+  }
+  if (Type == Bitcode)
+  {
+    WriteBitcodeToFile(*M, Out, false, nullptr, ModuleHash);
+    return false;
+  }
+
+  // The object writer seeks back to patch headers, which a pipe cannot do
+  buffer_ostream Buffer(Out);
+  legacy::PassManager PM;
+  if (TM->addPassesToEmitFile(PM, Buffer, nullptr, Type == Object ? CGFT_ObjectFile : CGFT_AssemblyFile))
+  {
+    errs() << "The host target cannot emit this file type\n";
+    return true;
+  }
+  PM.run(*M);
+  return false;
+}
+
+// Creates a JIT for the host with the runtime defined in it. Returns null
+// and says why if code cannot be run on the host.
+static std::unique_ptr<orc::LLJIT> createJIT(unsigned OptLevel)
+{
+  Expected<orc::JITTargetMachineBuilder> JTMB = orc::JITTargetMachineBuilder::detectHost();
+  if (!JTMB)
+  {
+    logAllUnhandledErrors(JTMB.takeError(), errs(), "Cannot run code on the host: ");
+    return nullptr;
+  }
+  // Programs run this way are mostly short, so at -O0 the fast instruction
+  // selector is worth more than the code it gives up
+  JTMB->setCodeGenOptLevel(OptLevel == 0 ? CodeGenOpt::None : OptLevel == 3 ? CodeGenOpt::Aggressive : CodeGenOpt::Default);
+  Expected<std::unique_ptr<orc::LLJIT>> J = orc::LLJITBuilder().setJITTargetMachineBuilder(std::move(*JTMB)).create();
+  if (!J)
+  {
+    logAllUnhandledErrors(J.takeError(), errs(), "Cannot run code on the host: ");
+    return nullptr;
+  }
+
+  // The module only calls the runtime, whose functions are looked up at
+  // their addresses in this process rather than by searching its symbols
+  orc::MangleAndInterner Mangle((*J)->getExecutionSession(), (*J)->getDataLayout());
+  JITSymbolFlags Flags = JITSymbolFlags::Exported | JITSymbolFlags::Callable;
+  orc::SymbolMap Runtime;
+  Runtime[Mangle("print_int")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&print_int), Flags);
+  Runtime[Mangle("print_bool")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&print_bool), Flags);
+  Runtime[Mangle("print_str")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&print_str), Flags);
+  Runtime[Mangle("compiler_read")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&compiler_read), Flags);
+  Runtime[Mangle("par_for")] = JITEvaluatedSymbol(pointerToJITTargetAddress(&par_for), Flags);
+  if (Error E = (*J)->getMainJITDylib().define(orc::absoluteSymbols(std::move(Runtime))))
+  {
+    logAllUnhandledErrors(std::move(E), errs(), "Cannot run code on the host: ");
+    return nullptr;
+  }
+  return std::move(*J);
+}
+
+bool CodeGen::run(orc::ThreadSafeModule TSM, unsigned OptLevel)
+{
+  std::unique_ptr<orc::LLJIT> J = createJIT(OptLevel);
+  if (!J)
+    return true;
+  if (Error E = J->addIRModule(std::move(TSM)))
+  {
+    logAllUnhandledErrors(std::move(E), errs(), "Cannot run code on the host: ");
+    return true;
+  }
+  Expected<JITEvaluatedSymbol> Main = J->lookup("main");
+  if (!Main)
+  {
+    logAllUnhandledErrors(Main.takeError(), errs(), "Cannot run code on the host: ");
+    return true;
+  }
+  char Name[] = "compiler";
+  char *Argv[] = {Name, nullptr};
+  jitTargetAddressToFunction<int (*)(int, char **)>(Main->getAddress())(1, Argv);
+  fflush(stdout);
+  return false;
+}
+
+bool CodeGen::compile(Program *Tree, unsigned OptLevel, bool SSA)
 {
   // Create an LLVM context and a module.
-  LLVMContext Ctx;
-  Module *M = new Module("simple-compiler", Ctx);
+  std::unique_ptr<LLVMContext> Ctx = std::make_unique<LLVMContext>();
+  std::unique_ptr<Module> M = std::make_unique<Module>("simple-compiler", *Ctx);
 
   // Create an instance of the ToIRVisitor and run it on the AST to generate LLVM IR.
-  ns::ToIRVisitor *ToIR = new ns::ToIRVisitor(M);
+  ns::ToIRVisitor *ToIR = new ns::ToIRVisitor(M.get(), SSA);
 
 
   ToIR->run(Tree);
 
-  // Print the generated module to the standard output.
-  M->print(outs(), nullptr);
+  // Optimize the module and write it out.
+  return emit(orc::ThreadSafeModule(std::move(M), std::move(Ctx)), OptLevel);
+}
+
+bool CodeGen::compileOutput(llvm::StringRef Output)
+{
+  std::unique_ptr<LLVMContext> Ctx = std::make_unique<LLVMContext>();
+  std::unique_ptr<Module> M = std::make_unique<Module>("simple-compiler", *Ctx);
+  IRBuilder<> Builder(*Ctx);
+
+  FunctionType *MainFty = FunctionType::get(Builder.getInt32Ty(), {Builder.getInt32Ty(), Builder.getInt8PtrTy()->getPointerTo()}, false);
+  Function *MainFn = Function::Create(MainFty, GlobalValue::ExternalLinkage, "main", M.get());
+  Builder.SetInsertPoint(BasicBlock::Create(*Ctx, "entry", MainFn));
+
+  // Print the whole output with a single call to the runtime.
+  if (!Output.empty())
+  {
+    FunctionType *PrintStrFnTy = FunctionType::get(Builder.getVoidTy(), {Builder.getInt8PtrTy()}, false);
+    Function *PrintStrFn = Function::Create(PrintStrFnTy, GlobalValue::ExternalLinkage, "print_str", M.get());
+    Builder.CreateCall(PrintStrFnTy, PrintStrFn, {Builder.CreateGlobalStringPtr(Output)});
+  }
+  Builder.CreateRet(Builder.getInt32(0));
+
+  return emit(orc::ThreadSafeModule(std::move(M), std::move(Ctx)), 0);
+}
+
+LoopJIT::LoopJIT(unsigned OptLevel) : OptLevel(OptLevel), NumLoops(0) {}
+
+LoopJIT::~LoopJIT() {}
+
+LoopJIT::LoopFn LoopJIT::compile(AST *Loop, unsigned &NumInts, unsigned &NumBools)
+{
+  if (!J)
+  {
+    std::string Error;
+    if (!(TM = createHostMachine(OptLevel, Error)))
+    {
+      errs() << "Cannot compile the loop: " << Error << "\n";
+      return nullptr;
+    }
+    if (!(J = createJIT(OptLevel)))
+      return nullptr;
+  }
+
+  std::unique_ptr<LLVMContext> Ctx = std::make_unique<LLVMContext>();
+  std::unique_ptr<Module> M = std::make_unique<Module>("simple-compiler", *Ctx);
+  M->setDataLayout(J->getDataLayout());
+  M->setTargetTriple(J->getTargetTriple().str());
+  std::string Name = "loop." + std::to_string(NumLoops++);
+  ns::ToIRVisitor ToIR(M.get());
+  ToIR.runLoop(Loop, Name, NumInts, NumBools);
+  optimize(M.get(), OptLevel, TM.get());
+
+  if (Error E = J->addIRModule(orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+  {
+    logAllUnhandledErrors(std::move(E), errs(), "Cannot compile the loop: ");
+    return nullptr;
+  }
+  Expected<JITEvaluatedSymbol> Fn = J->lookup(Name);
+  if (!Fn)
+  {
+    logAllUnhandledErrors(Fn.takeError(), errs(), "Cannot compile the loop: ");
+    return nullptr;
+  }
+  return jitTargetAddressToFunction<LoopFn>(Fn->getAddress());
 }
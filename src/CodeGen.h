@@ -2,11 +2,108 @@
 #define CODEGEN_H
 
 #include "AST.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+
+namespace llvm {
+class TargetMachine;
+namespace orc {
+class LLJIT;
+}
+}
+
+namespace ns {
+class ToIRVisitor;
+}
 
 class CodeGen
 {
 public:
- void compile(Program *Tree);
+ // The OptLevel of -Os; 0 to 3 stand for -O0 to -O3
+ static const unsigned OptSize = 4;
+
+ // What the module is written as. Assembly and objects are generated for the
+ // host by its TargetMachine. JIT writes nothing: the module is compiled in
+ // memory and its main run in this process, against the runtime linked into
+ // the compiler.
+ enum FileType { IR, Bitcode, Assembly, Object, JIT };
+
+private:
+ FileType Type;
+ llvm::raw_ostream &Out;
+ bool ModuleHash; // Of the bitcode, for tools caching what they derive from it
+
+ // Writes the module to Out, or runs it for JIT, which takes it with its
+ // context. Returns true and says why if the host cannot be targeted.
+ bool emit(llvm::orc::ThreadSafeModule TSM, unsigned OptLevel);
+
+ // Runs the main of the module with ORC's LLJIT
+ bool run(llvm::orc::ThreadSafeModule TSM, unsigned OptLevel);
+
+public:
+ CodeGen(FileType Type = IR, llvm::raw_ostream &Out = llvm::outs(), bool ModuleHash = false)
+     : Type(Type), Out(Out), ModuleHash(ModuleHash) {}
+
+ // Generates the module and runs the LLVM pipeline of OptLevel on it, none for 0.
+ // With SSA, variables are generated as SSA values instead of stack slots.
+ // Returns true if the module cannot be emitted.
+ bool compile(Program *Tree, unsigned OptLevel = 0, bool SSA = false);
+
+ // Emits a main that only prints Output, for programs evaluated at compile time.
+ bool compileOutput(llvm::StringRef Output);
+
+};
+
+// LoopJIT compiles single loops of a program into this process, for
+// TieredRunner to switch to when the interpreter finds them hot. The JIT is
+// created with the first loop.
+class LoopJIT
+{
+ std::unique_ptr<llvm::TargetMachine> TM;
+ std::unique_ptr<llvm::orc::LLJIT> J;
+ unsigned OptLevel;
+ unsigned NumLoops; // Compiled so far, to name their functions
+
+public:
+ // The code of a loop, entered at its header: a for loop's initialization has
+ // run already. The variables are read from Ints and Bools, indexed by Sema's
+ // slot, and written back when the loop exits.
+ typedef void (*LoopFn)(int32_t *Ints, bool *Bools);
+
+ LoopJIT(unsigned OptLevel);
+ ~LoopJIT();
+
+ // Compiles Loop, a WhileStmt or ForStmt of a checked program, with the
+ // pipeline of OptLevel. NumInts and NumBools are set to the slots the code
+ // reads. Returns null and says why if the host cannot run it.
+ LoopFn compile(AST *Loop, unsigned &NumInts, unsigned &NumBools);
+};
+
+// ChunkCodeGen generates the top-level statements of a program one at a time,
+// for IncrementalCompiler. Each statement becomes a function that keeps the
+// top-level variables in globals named after them, so its code only depends
+// on its text and the types of the variables it uses.
+class ChunkCodeGen
+{
+ llvm::LLVMContext Ctx;
+ std::unique_ptr<llvm::Module> M;
+ std::unique_ptr<ns::ToIRVisitor> ToIR;
+
+public:
+ ChunkCodeGen();
+ ~ChunkCodeGen();
+
+ // Returns the text of `define internal void @Name()` running the checked
+ // statement Stmt. Globals gives the top-level variables it uses or declares
+ // with the storage Sema gave them in the statement.
+ std::string emit(AST *Stmt, llvm::StringRef Name, llvm::ArrayRef<std::pair<llvm::StringRef, VarRef>> Globals);
 
+ // Prints a module defining the globals of the top-level variables and the
+ // functions of the statements, with a main calling them in order.
+ static void printModule(llvm::raw_ostream &OS, llvm::ArrayRef<std::pair<llvm::StringRef, VarRef>> Globals,
+                         llvm::ArrayRef<llvm::StringRef> Functions, llvm::ArrayRef<llvm::StringRef> Calls);
 };
 #endif
\ No newline at end of file
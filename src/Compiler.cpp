@@ -1,12 +1,24 @@
 #include "Lexer.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SystemUtils.h"
 #include "llvm/Support/raw_ostream.h"
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include "AST.h"
 #include "CodeGen.h"
+#include "CostModel.h"
+#include "Incremental.h"
 #include "Parser.h"
+#include "PartialEval.h"
+#include "PassManager.h"
+#include "PerfLint.h"
 #include "Sema.h"
+#include "Tiered.h"
 
 // Define a command-line option for specifying the input expression.
 static llvm::cl::opt<std::string>
@@ -14,17 +26,253 @@ static llvm::cl::opt<std::string>
           llvm::cl::desc("<input expression>"),
           llvm::cl::init(""));
 
+// Define a command-line option for reading the program from a file, for
+// programs longer than the command line allows.
+static llvm::cl::opt<std::string>
+    InputFile("input-file",
+              llvm::cl::desc("Read the program from a file instead of the command line"),
+              llvm::cl::value_desc("filename"),
+              llvm::cl::init(""));
+
+// Define command-line options for compiling statement by statement.
+static llvm::cl::opt<bool>
+    Incremental("incremental",
+                llvm::cl::desc("Compile the top-level statements separately, without the AST passes or optimizations"),
+                llvm::cl::init(false));
+
+static llvm::cl::opt<bool>
+    Watch("watch",
+          llvm::cl::desc("Compile -input-file incrementally again each time it changes"),
+          llvm::cl::init(false));
+
+// Define command-line options for the file the module is written to.
+static llvm::cl::opt<std::string>
+    OutputFile("o",
+               llvm::cl::desc("File to write the module to"),
+               llvm::cl::value_desc("filename"),
+               llvm::cl::init("-"));
+
+static llvm::cl::opt<CodeGen::FileType>
+    FileType("filetype",
+             llvm::cl::desc("Kind of file to write:"),
+             llvm::cl::values(clEnumValN(CodeGen::IR, "ll", "LLVM IR (default)"),
+                              clEnumValN(CodeGen::Bitcode, "bc", "LLVM bitcode"),
+                              clEnumValN(CodeGen::Assembly, "asm", "Assembly for the host"),
+                              clEnumValN(CodeGen::Object, "obj", "Object file for the host")),
+             llvm::cl::init(CodeGen::IR));
+
+static llvm::cl::opt<bool>
+    EmitBitcode("emit-bc",
+                llvm::cl::desc("Write LLVM bitcode, like -filetype=bc"),
+                llvm::cl::init(false));
+
+static llvm::cl::opt<bool>
+    ModuleHash("module-hash",
+               llvm::cl::desc("Put a hash of the module in the bitcode"),
+               llvm::cl::init(false));
+
+// Define a command-line option for running the program instead of writing it.
+static llvm::cl::opt<bool>
+    Run("run",
+        llvm::cl::desc("Run the program in the compiler with the JIT instead of writing a module"),
+        llvm::cl::init(false));
+
+// Define command-line options for interpreting the program and compiling
+// only its hot loops.
+static llvm::cl::opt<bool>
+    Tiered("tiered",
+           llvm::cl::desc("With -run, interpret the program and compile only its hot loops (at -O2 unless a level is given)"),
+           llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned>
+    HotLoop("hot-loop",
+            llvm::cl::desc("Back-edges a loop takes in the -tiered interpreter before it is compiled (0 never compiles)"),
+            llvm::cl::init(10000));
+
+// Define a command-line option for the number of semantic analysis threads.
+static llvm::cl::opt<unsigned>
+    SemaThreads("sema-threads",
+                llvm::cl::desc("Number of threads used by semantic analysis"),
+                llvm::cl::init(1));
+
+// Define command-line options for evaluating the program at compile time.
+static llvm::cl::opt<bool>
+    PartialEvaluation("partial-eval",
+                      llvm::cl::desc("Run the program at compile time and emit code that only prints its output"),
+                      llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned>
+    EvalBudget("eval-budget",
+               llvm::cl::desc("Number of steps -partial-eval may take before falling back to code generation"),
+               llvm::cl::init(10000000));
+
+// Define command-line options for the AST passes run between Sema and CodeGen.
+static llvm::cl::opt<std::string>
+    ASTPasses("ast-passes",
+              llvm::cl::desc("Comma-separated list of AST passes to run before code generation"),
+              llvm::cl::init(ASTPassManager::DefaultPipeline));
+
+static llvm::cl::opt<bool>
+    TimeASTPasses("time-ast-passes",
+                  llvm::cl::desc("Print the time and the node count change of each AST pass"),
+                  llvm::cl::init(false));
+
+// Define a command-line option for the performance warnings.
+static llvm::cl::opt<bool>
+    WarnPerf("Wperf",
+             llvm::cl::desc("Warn about constructs the code generator makes slow"),
+             llvm::cl::init(false));
+
+// Define a command-line option for the optimization level.
+enum OptLevelOption : unsigned { O0, O1, O2, O3, Os = CodeGen::OptSize };
+static llvm::cl::opt<OptLevelOption>
+    OptLevelFlag(llvm::cl::desc("Optimization level, instead of the one -compile-budget picks:"),
+                 llvm::cl::values(clEnumVal(O0, "No optimizations (default)"),
+                                  clEnumVal(O1, "Optimize quickly"),
+                                  clEnumVal(O2, "Optimize for speed"),
+                                  clEnumVal(O3, "Optimize for speed more aggressively"),
+                                  clEnumVal(Os, "Optimize like -O2 while keeping the code small")),
+                 llvm::cl::init(O0));
+
+// Define a command-line option for choosing the optimization level automatically.
+static llvm::cl::opt<unsigned>
+    CompileBudget("compile-budget",
+                  llvm::cl::desc("Milliseconds the compilation may take; picks the optimization level that fits and reports why (0 runs no optimizations)"),
+                  llvm::cl::init(0));
+
+// Define a command-line option for building SSA form during code generation.
+static llvm::cl::opt<bool>
+    SSAForm("ssa",
+            llvm::cl::desc("Keep variables in SSA values with phis instead of stack slots"),
+            llvm::cl::init(false));
+
+// Compiles Source with Compiler and writes the module to the output file.
+// Returns true if the program has errors.
+static bool compileIncrementally(IncrementalCompiler &Compiler, llvm::StringRef Source)
+{
+    std::string Module;
+    llvm::raw_string_ostream OS(Module);
+    if (Compiler.update(Source, OS, llvm::errs()))
+        return true;
+    std::error_code EC;
+    llvm::raw_fd_ostream Out(OutputFile, EC);
+    if (EC)
+    {
+        llvm::errs() << "Cannot write " << OutputFile << ": " << EC.message() << "\n";
+        return true;
+    }
+    Out << OS.str();
+    return false;
+}
+
+// Compiles the input file each time its modification time changes, reusing
+// what did not change since the last time. Runs until it is killed.
+static int watch()
+{
+    IncrementalCompiler Compiler;
+    llvm::sys::TimePoint<> Seen;
+    bool First = true;
+    for (;; std::this_thread::sleep_for(std::chrono::milliseconds(100)))
+    {
+        llvm::sys::fs::file_status Status;
+        if (llvm::sys::fs::status(InputFile, Status) || (!First && Status.getLastModificationTime() == Seen))
+            continue;
+        Seen = Status.getLastModificationTime();
+        First = false;
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer = llvm::MemoryBuffer::getFile(InputFile);
+        if (!Buffer)
+            continue;
+
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+        bool Errors = compileIncrementally(Compiler, (*Buffer)->getBuffer());
+        double Elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+        const IncrementalCompiler::Stats &Stats = Compiler.getStats();
+        llvm::errs() << (Errors ? "Failed" : "Compiled") << " in " << llvm::format("%.1f", Elapsed) << " ms: "
+                     << Stats.Statements << " statements, " << Stats.LexedBytes << " bytes lexed, " << Stats.Parsed
+                     << " parsed, " << Stats.Checked << " checked\n";
+    }
+}
+
 // The main function of the program.
 int main(int argc, const char **argv)
 {
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
     // Initialize the LLVM framework.
     llvm::InitLLVM X(argc, argv);
 
     // Parse command-line options.
     llvm::cl::ParseCommandLineOptions(argc, argv, "Simple Compiler\n");
 
+    if (EmitBitcode)
+    {
+        if (FileType.getNumOccurrences() && FileType != CodeGen::Bitcode)
+        {
+            llvm::errs() << "-emit-bc conflicts with -filetype\n";
+            return 1;
+        }
+        FileType = CodeGen::Bitcode;
+    }
+    if (ModuleHash && FileType != CodeGen::Bitcode)
+    {
+        llvm::errs() << "-module-hash needs bitcode output\n";
+        return 1;
+    }
+
+    if (Tiered && !Run)
+    {
+        llvm::errs() << "-tiered needs -run\n";
+        return 1;
+    }
+    if (Run)
+    {
+        if (FileType.getNumOccurrences() || EmitBitcode || OutputFile.getNumOccurrences())
+        {
+            llvm::errs() << "-run writes no module\n";
+            return 1;
+        }
+        FileType = CodeGen::JIT;
+    }
+
+    if ((Incremental || Watch) && FileType != CodeGen::IR)
+    {
+        llvm::errs() << "-incremental and -watch only write LLVM IR, and cannot -run\n";
+        return 1;
+    }
+
+    if (Watch)
+    {
+        if (InputFile.empty())
+        {
+            llvm::errs() << "-watch needs -input-file\n";
+            return 1;
+        }
+        return watch();
+    }
+
+    // The buffers of files end with a NUL, which the lexer relies on.
+    llvm::StringRef Source = Input;
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    if (!InputFile.empty())
+    {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> File = llvm::MemoryBuffer::getFile(InputFile);
+        if (!File)
+        {
+            llvm::errs() << "Cannot read " << InputFile << ": " << File.getError().message() << "\n";
+            return 1;
+        }
+        Buffer = std::move(*File);
+        Source = Buffer->getBuffer();
+    }
+
+    if (Incremental)
+    {
+        IncrementalCompiler Compiler;
+        return compileIncrementally(Compiler, Source) ? 1 : 0;
+    }
+
     // Create a lexer object and initialize it with the input expression.
-    Lexer Lex(Input);
+    Lexer Lex(Source);
 
     // Create a parser object and initialize it with the lexer.
     Parser Parser(Lex);
@@ -41,15 +289,70 @@ int main(int argc, const char **argv)
 
     // Perform semantic analysis on the AST.
     Sema Semantic;
-    if (Semantic.semantic(Tree))
+    if (Semantic.semantic(Tree, SemaThreads))
     {
         llvm::errs() << "Semantic errors occurred\n";
         return 1;
     }
 
-    // Generate code for the AST using a code generator.
-    CodeGen CodeGenerator;
-    CodeGenerator.compile(Tree);
+    // Run the AST passes. Some of them find errors, like a divisor that is
+    // always zero. The manager owns the passes, which may own parts of the tree.
+    ASTPassManager Passes;
+    if (Passes.parsePipeline(ASTPasses, llvm::errs()))
+        return 1;
+    bool PassErrors = Passes.run(Tree, TimeASTPasses);
+    if (TimeASTPasses)
+        Passes.printSummary(llvm::errs());
+    if (PassErrors)
+    {
+        llvm::errs() << "Semantic errors occurred\n";
+        return 1;
+    }
+
+    // Report the slow constructs left in the tree the code generator gets.
+    if (WarnPerf)
+    {
+        PerfLint Lint;
+        Lint.check(Tree, llvm::errs());
+    }
+
+    // Start running the program at once and compile the loops it spends its
+    // time in.
+    if (Tiered)
+    {
+        TieredRunner Runner(OptLevelFlag.getNumOccurrences() ? OptLevelFlag : O2, HotLoop);
+        Runner.run(Tree);
+        return 0;
+    }
+
+    // Generate code for the AST using a code generator. If the program can be
+    // run at compile time, only its output is needed.
+    std::error_code EC;
+    bool Binary = FileType == CodeGen::Bitcode || FileType == CodeGen::Object;
+    llvm::raw_fd_ostream Out(OutputFile, EC, Binary ? llvm::sys::fs::OF_None : llvm::sys::fs::OF_Text);
+    if (EC)
+    {
+        llvm::errs() << "Cannot write " << OutputFile << ": " << EC.message() << "\n";
+        return 1;
+    }
+    if (FileType == CodeGen::Bitcode && llvm::CheckBitcodeOutputToConsole(Out))
+        return 1;
+    CodeGen CodeGenerator(FileType, Out, ModuleHash);
+    PartialEval Evaluator;
+    if (PartialEvaluation && Evaluator.evaluate(Tree, EvalBudget))
+        return CodeGenerator.compileOutput(Evaluator.getOutput()) ? 1 : 0;
+
+    // Spend what is left of the budget on the optimizations the cost model
+    // predicts to fit, unless the level is given.
+    unsigned OptLevel = OptLevelFlag;
+    if (CompileBudget && !OptLevelFlag.getNumOccurrences())
+    {
+        double Elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+        CostModel Model;
+        OptLevel = CostModel::chooseOptLevel(Model.estimate(Tree), CompileBudget - Elapsed, llvm::errs());
+    }
+    if (CodeGenerator.compile(Tree, OptLevel, SSAForm))
+        return 1;
 
     // The program executed successfully.
     return 0;
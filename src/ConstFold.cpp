@@ -0,0 +1,274 @@
+#include "ConstFold.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+
+namespace nfold{
+class Folder : public ASTVisitor {
+  llvm::StringSaver &Saver;
+  bool IsConst;   // Whether the node visited last is a constant
+  bool IsLiteral; // Whether it is a literal already
+  int32_t Val;    // Its value if it is constant; 0 or 1 for a condition
+  bool HasError; // Flag to indicate if an error occurred
+
+  static int32_t wrap(uint32_t V) { return (int32_t)V; }
+
+  // Visits E and returns the node to use in its place.
+  Expr *foldExpr(Expr *E) {
+    if (!E) {
+      // A dropped initializer
+      IsConst = false;
+      return E;
+    }
+    E->accept(*this);
+    if (!IsConst || IsLiteral)
+      return E;
+    return new Final(Final::Number, Saver.save(llvm::Twine(Val)));
+  }
+
+  Logic *foldLogic(Logic *L) {
+    if (!L) {
+      IsConst = false;
+      return L;
+    }
+    L->accept(*this);
+    if (!IsConst || IsLiteral)
+      return L;
+    return new Comparison(nullptr, nullptr, Val ? Comparison::True : Comparison::False);
+  }
+
+  void divisionByZero() {
+    llvm::errs() << "Division by zero is not allowed." << "\n";
+    HasError = true;
+  }
+
+  void foldBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+  }
+
+public:
+  Folder(llvm::StringSaver &Saver) : Saver(Saver), IsConst(false), IsLiteral(false), Val(0), HasError(false) {}
+
+  bool hasError() { return HasError; }
+
+  virtual void visit(Program &Node) override {
+    foldBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &Node) override {
+    // Literals that do not fit in 32 bits are left to the code generator
+    IsConst = Node.getKind() == Final::Number && !Node.getVal().getAsInteger(10, Val);
+    IsLiteral = Node.getKind() == Final::Number;
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    IsConst = !Node.getValue().getAsInteger(10, Val);
+    IsLiteral = true;
+    if (IsConst && Node.getSign() == SignedNumber::Minus)
+      Val = wrap(0u - (uint32_t)Val);
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    IsConst = false;
+    IsLiteral = false;
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    Node.setExpr(foldExpr(Node.getExpr()));
+    IsLiteral = false;
+    if (IsConst)
+      Val = wrap(0u - (uint32_t)Val);
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    Node.setLeft(foldExpr(Node.getLeft()));
+    bool LeftConst = IsConst;
+    int32_t L = Val;
+    Node.setRight(foldExpr(Node.getRight()));
+    int32_t R = Val;
+    IsLiteral = false;
+    if (IsConst && R == 0 && (Node.getOperator() == BinaryOp::Div || Node.getOperator() == BinaryOp::Mod)) {
+      divisionByZero();
+      IsConst = false;
+      return;
+    }
+    IsConst = LeftConst && IsConst;
+    if (!IsConst)
+      return;
+
+    switch (Node.getOperator())
+    {
+    case BinaryOp::Plus:
+      Val = wrap((uint32_t)L + (uint32_t)R);
+      break;
+    case BinaryOp::Minus:
+      Val = wrap((uint32_t)L - (uint32_t)R);
+      break;
+    case BinaryOp::Mul:
+      Val = wrap((uint32_t)L * (uint32_t)R);
+      break;
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+      if (L == INT32_MIN && R == -1)
+        IsConst = false; // Overflows at run time as well, leave it alone
+      else
+        Val = Node.getOperator() == BinaryOp::Div ? L / R : L % R;
+      break;
+    case BinaryOp::Exp: {
+      // Matches CreateExp: L multiplied R times, 1 for R <= 0
+      uint32_t Base = L, Res = 1;
+      for (uint32_t E = R > 0 ? R : 0; E; E >>= 1) {
+        if (E & 1)
+          Res *= Base;
+        Base *= Base;
+      }
+      Val = wrap(Res);
+      break;
+    }
+    default:
+      IsConst = false;
+      break;
+    }
+  };
+
+  virtual void visit(Comparison &Node) override {
+    switch (Node.getOperator())
+    {
+    case Comparison::True:
+    case Comparison::False:
+      IsConst = true;
+      IsLiteral = true;
+      Val = Node.getOperator() == Comparison::True;
+      return;
+    case Comparison::Ident:
+      IsConst = false;
+      IsLiteral = false;
+      return;
+    default:
+      break;
+    }
+    Node.setLeft(foldExpr(Node.getLeft()));
+    bool LeftConst = IsConst;
+    int32_t L = Val;
+    Node.setRight(foldExpr(Node.getRight()));
+    int32_t R = Val;
+    IsLiteral = false;
+    IsConst = LeftConst && IsConst;
+    if (!IsConst)
+      return;
+
+    switch (Node.getOperator())
+    {
+    case Comparison::Equal:
+      Val = L == R;
+      break;
+    case Comparison::Not_equal:
+      Val = L != R;
+      break;
+    case Comparison::Greater:
+      Val = L > R;
+      break;
+    case Comparison::Less:
+      Val = L < R;
+      break;
+    case Comparison::Greater_equal:
+      Val = L >= R;
+      break;
+    case Comparison::Less_equal:
+      Val = L <= R;
+      break;
+    default:
+      IsConst = false;
+      break;
+    }
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    Node.setLeft(foldLogic(Node.getLeft()));
+    bool LeftConst = IsConst;
+    int32_t L = Val;
+    IsLiteral = false;
+    if (!Node.getRight()) {
+      IsConst = LeftConst;
+      return;
+    }
+    Node.setRight(foldLogic(Node.getRight()));
+    IsLiteral = false;
+    // A left operand that decides the result skips the right one, whatever it is
+    bool Decides = LeftConst && (Node.getOperator() == LogicalExpr::And ? !L : L);
+    IsConst = Decides || (LeftConst && IsConst);
+    if (Decides)
+      Val = L != 0;
+    else if (IsConst)
+      Val = Val != 0;
+  };
+
+  virtual void visit(Assignment &Node) override {
+    if (Node.getRightExpr()) {
+      Node.setRightExpr(foldExpr(Node.getRightExpr()));
+      if (IsConst && Val == 0 && Node.getAssignKind() == Assignment::Slash_assign)
+        divisionByZero();
+    }
+    else
+      Node.setRightLogic(foldLogic(Node.getRightLogic()));
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    unsigned I = 0;
+    for (llvm::SmallVector<Expr *>::const_iterator V = Node.valBegin(), E = Node.valEnd(); V != E; ++V, ++I)
+      Node.setValue(I, foldExpr(*V));
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    unsigned I = 0;
+    for (llvm::SmallVector<Logic *>::const_iterator V = Node.valBegin(), E = Node.valEnd(); V != E; ++V, ++I)
+      Node.setValue(I, foldLogic(*V));
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    Node.setCond(foldLogic(Node.getCond()));
+    foldBody(Node.begin(), Node.end());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    foldBody(Node.beginElse(), Node.endElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    Node.setCond(foldLogic(Node.getCond()));
+    foldBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    // The labels are literals already
+    Node.setCond(foldExpr(Node.getCond()));
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    foldBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    Node.setCond(foldLogic(Node.getCond()));
+    foldBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    Node.getFirst()->accept(*this);
+    Node.setSecond(foldLogic(Node.getSecond()));
+    if (Node.getThirdAssign())
+      Node.getThirdAssign()->accept(*this);
+    foldBody(Node.begin(), Node.end());
+  };
+};
+}
+
+bool ConstFold::fold(Program *Tree) {
+  nfold::Folder F(Saver);
+  Tree->accept(F);
+  return F.hasError();
+}
@@ -0,0 +1,24 @@
+#ifndef CONSTFOLD_H
+#define CONSTFOLD_H
+
+#include "AST.h"
+#include "PassManager.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+
+class ConstFold : public ASTPass
+{
+  llvm::BumpPtrAllocator Alloc;
+  llvm::StringSaver Saver; // Owns the text of the literals created by folding
+
+public:
+  ConstFold() : Saver(Alloc) {}
+
+  // Replaces every constant subtree of the program by a literal, computed with
+  // the same 32-bit wrap-around arithmetic as the generated code. The folder
+  // must outlive the tree. Returns true if a constant division by zero was found.
+  bool fold(Program *Tree);
+
+  bool run(Program *Tree) override { return fold(Tree); }
+};
+#endif
@@ -0,0 +1,249 @@
+#include "CostModel.h"
+#include "llvm/Support/Format.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ncost{
+// Trip count guessed for a loop whose bounds are not known
+static const double DefaultTrips = 100;
+
+// Bits guessed for the exponent of a '^' that is not a literal
+static const double DefaultExpBits = 3;
+
+// Counts the IR instructions CodeGen emits for every node, and weights them
+// by the product of the trip counts of the loops around the node
+class Estimator : public ASTVisitor {
+  uint64_t Instructions;
+  double Executed;
+  double Weight; // Times the current point runs
+  unsigned Loops;
+  unsigned Depth;
+  unsigned MaxDepth;
+
+  void add(unsigned N) {
+    Instructions += N;
+    Executed += N * Weight;
+  }
+
+  void estimate(AST *Node) {
+    if (Node)
+      Node->accept(*this);
+  }
+
+  void visitBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+  }
+
+  // Runs F for the part of a loop that runs Trips times
+  template <typename Fn> void loop(double Trips, Fn F) {
+    double SavedWeight = Weight;
+    ++Loops;
+    ++Depth;
+    MaxDepth = std::max(MaxDepth, Depth);
+    Weight *= Trips;
+    F();
+    Weight = SavedWeight;
+    --Depth;
+  }
+
+public:
+  Estimator() : Instructions(0), Executed(0), Weight(1), Loops(0), Depth(0), MaxDepth(0) {}
+
+  ProgramCost getCost() { return {Instructions, Executed, Loops, MaxDepth}; }
+
+  virtual void visit(Program &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &Node) override {
+    if (Node.getKind() == Final::Ident)
+      add(1); // load
+  };
+
+  virtual void visit(SignedNumber &) override {};
+
+  virtual void visit(UnaryOp &) override {
+    add(3); // load, add, store
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    estimate(Node.getExpr());
+    add(1);
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    estimate(Node.getLeft());
+    estimate(Node.getRight());
+    if (Node.getOperator() != BinaryOp::Exp) {
+      add(1);
+      return;
+    }
+    // CreateExp emits 3 instructions around a loop of 10 that runs once per bit
+    // of the exponent; a literal exponent gets a chain of multiplications that
+    // is no longer
+    add(3);
+    Instructions += 10;
+    Executed += 10 * DefaultExpBits * Weight;
+  };
+
+  virtual void visit(Comparison &Node) override {
+    estimate(Node.getLeft());
+    estimate(Node.getRight());
+    if (Node.getRight())
+      add(1);
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    estimate(Node.getLeft());
+    estimate(Node.getRight());
+    if (Node.getRight())
+      add(1);
+  };
+
+  virtual void visit(Assignment &Node) override {
+    estimate(Node.getRightExpr());
+    estimate(Node.getRightLogic());
+    // The target is loaded, combined for a compound assignment, and stored
+    add(Node.getAssignKind() == Assignment::Assign ? 2 : 3);
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    for (llvm::SmallVector<Expr *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      if (*I) {
+        (*I)->accept(*this);
+        add(1); // store
+      }
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    for (llvm::SmallVector<Logic *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      if (*I) {
+        (*I)->accept(*this);
+        add(1); // store
+      }
+  };
+
+  virtual void visit(PrintStmt &) override {
+    add(2); // load, call
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    add(2); // branches into and out of the condition
+    estimate(Node.getCond());
+    visitBody(Node.begin(), Node.end());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    visitBody(Node.beginElse(), Node.endElse());
+    add(1);
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    add(2);
+    estimate(Node.getCond());
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    estimate(Node.getCond());
+    add(1); // the switch
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+    add(1); // branch to the next arm
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    add(1);
+    loop(DefaultTrips, [&] {
+      estimate(Node.getCond());
+      visitBody(Node.begin(), Node.end());
+      add(2);
+    });
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    estimate(Node.getFirst());
+    add(1);
+    ValueRange Range = Node.getBodyRange();
+    double Trips = Range.isKnown() ? (double)Range.getHi() - Range.getLo() + 1 : DefaultTrips;
+    loop(Trips, [&] {
+      if (Range.isKnown())
+        add(5); // load and the assumptions on both bounds
+      estimate(Node.getSecond());
+      visitBody(Node.begin(), Node.end());
+      estimate(Node.getThirdAssign());
+      estimate(Node.getThirdUnary());
+      add(2);
+    });
+  };
+};
+
+// Microseconds per instruction measured for generating the module, and for
+// running the pipeline of each level and printing the result. Everything is
+// in one function, so the loop passes revisit all of it for every loop; their
+// time was measured to grow with the size times the square root of the number
+// of loops.
+static const double EmitMicros = 0.3;
+static const double OptMicros[] = {1.0, 2.7, 2.7, 2.8};
+static const double LoopMicros[] = {0, 9, 9, 9};
+
+// Programs this small are fully optimized whatever their shape
+static const uint64_t SmallProgram = 2000;
+
+// Executed to emitted instruction ratios from which loops pay for -O2 and -O3
+static const double LoopyO2 = 2;
+static const double LoopyO3 = 10;
+}
+
+ProgramCost CostModel::estimate(Program *Tree) {
+  ncost::Estimator E;
+  Tree->accept(E);
+  return E.getCost();
+}
+
+double CostModel::predictMillis(const ProgramCost &Cost, unsigned OptLevel) {
+  double N = Cost.Instructions;
+  return (N * (ncost::EmitMicros + ncost::OptMicros[OptLevel]) + N * std::sqrt((double)Cost.Loops) * ncost::LoopMicros[OptLevel]) / 1000;
+}
+
+unsigned CostModel::chooseOptLevel(const ProgramCost &Cost, double BudgetMillis, llvm::raw_ostream &Report) {
+  double Hotness = Cost.Instructions ? Cost.Executed / Cost.Instructions : 0;
+  Report << llvm::format("opt-level: %llu instructions, %u loop%s nested %u deep, %.1f executions per instruction\n",
+                         (unsigned long long)Cost.Instructions, Cost.Loops, Cost.Loops == 1 ? "" : "s",
+                         Cost.MaxLoopDepth, Hotness);
+
+  // The level worth the time without a budget
+  unsigned Wanted;
+  const char *Why;
+  if (Cost.Instructions <= ncost::SmallProgram) {
+    Wanted = 3;
+    Why = "the program is small";
+  } else if (Hotness >= ncost::LoopyO3) {
+    Wanted = 3;
+    Why = "the program spends its time in loops";
+  } else if (Hotness >= ncost::LoopyO2) {
+    Wanted = 2;
+    Why = "part of the program runs in loops";
+  } else {
+    Wanted = 1;
+    Why = "most of the program is straight-line code that runs once";
+  }
+
+  unsigned Level = Wanted;
+  while (Level > 0 && predictMillis(Cost, Level) > BudgetMillis)
+    --Level;
+
+  Report << "opt-level: predicted";
+  for (unsigned L = 0; L <= 3; ++L)
+    Report << llvm::format(" -O%u %.1f ms%s", L, predictMillis(Cost, L), L == 3 ? "" : ",");
+  Report << llvm::format("; %.1f ms of the budget left\n", BudgetMillis);
+  Report << "opt-level: chose -O" << Level << ": " << Why;
+  if (Level < Wanted)
+    Report << ", lowered from -O" << Wanted << " to fit the budget";
+  Report << "\n";
+  return Level;
+}
@@ -0,0 +1,36 @@
+#ifndef COSTMODEL_H
+#define COSTMODEL_H
+
+#include "AST.h"
+#include "llvm/Support/raw_ostream.h"
+
+// ProgramCost is what CostModel estimates about a program before its code is
+// generated.
+struct ProgramCost
+{
+  uint64_t Instructions; // IR instructions CodeGen emits
+  double Executed;       // Instructions executed by one run, with guessed trip counts
+  unsigned Loops;
+  unsigned MaxLoopDepth;
+};
+
+class CostModel
+{
+public:
+  // Estimates the size of the code generated for the program and how often
+  // it runs. A for loop whose induction variable has a range is assumed to run
+  // once per value of the range, every other loop a fixed number of times.
+  ProgramCost estimate(Program *Tree);
+
+  // Returns the estimated milliseconds the LLVM pipeline of OptLevel (0 to 3,
+  // 0 running no passes) and the printing of the module take for the program.
+  static double predictMillis(const ProgramCost &Cost, unsigned OptLevel);
+
+  // Picks the highest optimization level worth running on the program whose
+  // predicted time fits in BudgetMillis. Small programs and programs that
+  // spend their time in loops get full optimization; large straight-line code
+  // runs once, so a cheap pipeline is enough for it. Explains the decision on
+  // Report.
+  static unsigned chooseOptLevel(const ProgramCost &Cost, double BudgetMillis, llvm::raw_ostream &Report);
+};
+#endif
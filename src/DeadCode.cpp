@@ -0,0 +1,620 @@
+#include "DeadCode.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include <cstdint>
+
+namespace ndce{
+using Body = llvm::SmallVectorImpl<AST *>;
+
+// Variables are keyed by slot and type. Sema reuses the slots of ended scopes,
+// so a key can stand for several variables; treating them as one is safe.
+static unsigned key(VarRef R) { return R.getSlot() * 2 + R.isBool(); }
+
+// Removes the code that constant conditions make unreachable. Runs after
+// ConstFold, so a constant condition is a True or False literal, except for
+// the condition of a for loop, which is evaluated with the initial value of
+// the induction variable to find the loops that never run.
+class Pruner : public ASTVisitor {
+  enum CondKind { Unknown, AlwaysTrue, AlwaysFalse };
+  enum Action { Keep, Drop, Replace, Splice };
+
+  Action Result;   // What to do with the statement visited last
+  AST *Replacement; // The statement that replaces it for Replace
+  Body *Spliced;   // The statements that replace it for Splice
+  CondKind Cond;   // Value of the condition visited last
+  bool Known;      // Whether the value of the expression visited last is known
+  int32_t Val;     // Its value
+  bool HasLoopVar; // Whether a for condition is being evaluated
+  VarRef LoopVar;  // Its induction variable
+  int32_t LoopVal; // The initial value of the induction variable
+  unsigned Removed;
+
+  // Replaces the statement visited last by Stmts
+  void splice(Body &Stmts) {
+    Spliced = &Stmts;
+    Result = Stmts.empty() ? Drop : Splice;
+  }
+
+public:
+  Pruner() : Result(Keep), Replacement(nullptr), Spliced(nullptr), Cond(Unknown), Known(false), Val(0), HasLoopVar(false), LoopVal(0), Removed(0) {}
+
+  unsigned getRemoved() { return Removed; }
+
+  // Rewrites the statements in place; only splicing in a longer body may
+  // grow the list.
+  void prune(Body &Stmts) {
+    unsigned W = 0;
+    for (unsigned R = 0; R != Stmts.size(); ++R) {
+      AST *S = Stmts[R];
+      Result = Keep;
+      S->accept(*this);
+      if (Result == Keep) {
+        Stmts[W++] = S;
+        continue;
+      }
+      ++Removed;
+      if (Result == Replace)
+        Stmts[W++] = Replacement;
+      else if (Result == Splice) {
+        Stmts.erase(Stmts.begin() + W, Stmts.begin() + R + 1);
+        Stmts.insert(Stmts.begin() + W, Spliced->begin(), Spliced->end());
+        W += Spliced->size();
+        R = W - 1;
+      }
+    }
+    Stmts.truncate(W);
+    // The statement whose body this is stays unless it says otherwise
+    Result = Keep;
+  }
+
+  virtual void visit(Program &Node) override {
+    prune(Node.getBody());
+  };
+
+  virtual void visit(Final &Node) override {
+    if (Node.getKind() == Final::Ident) {
+      Known = HasLoopVar && key(Node.getRef()) == key(LoopVar);
+      Val = LoopVal;
+    }
+    else
+      Known = !Node.getVal().getAsInteger(10, Val);
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    Known = !Node.getValue().getAsInteger(10, Val);
+    if (Known && Node.getSign() == SignedNumber::Minus)
+      Val = (int32_t)(0u - (uint32_t)Val);
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    Known = false;
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    Known = false;
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    Known = false;
+  };
+
+  virtual void visit(Comparison &Node) override {
+    Cond = Unknown;
+    switch (Node.getOperator())
+    {
+    case Comparison::True:
+      Cond = AlwaysTrue;
+      return;
+    case Comparison::False:
+      Cond = AlwaysFalse;
+      return;
+    case Comparison::Ident:
+      return;
+    default:
+      break;
+    }
+    if (!HasLoopVar)
+      return;
+    Node.getLeft()->accept(*this);
+    bool LeftKnown = Known;
+    int32_t L = Val;
+    Node.getRight()->accept(*this);
+    int32_t R = Val;
+    if (!LeftKnown || !Known)
+      return;
+
+    bool Taken;
+    switch (Node.getOperator())
+    {
+    case Comparison::Equal:
+      Taken = L == R;
+      break;
+    case Comparison::Not_equal:
+      Taken = L != R;
+      break;
+    case Comparison::Greater:
+      Taken = L > R;
+      break;
+    case Comparison::Less:
+      Taken = L < R;
+      break;
+    case Comparison::Greater_equal:
+      Taken = L >= R;
+      break;
+    case Comparison::Less_equal:
+      Taken = L <= R;
+      break;
+    default:
+      return;
+    }
+    Cond = Taken ? AlwaysTrue : AlwaysFalse;
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    Cond = Unknown;
+  };
+
+  virtual void visit(Assignment &Node) override {
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    llvm::SmallVectorImpl<elifStmt *> &Elifs = Node.getElifs();
+    Node.getCond()->accept(*this);
+    CondKind IfCond = Cond;
+    if (IfCond == AlwaysTrue) {
+      // Nothing after the if arm can be taken
+      Removed += Elifs.size() + (Node.beginElse() != Node.endElse());
+      prune(Node.getBody());
+      splice(Node.getBody());
+      return;
+    }
+    if (IfCond == AlwaysFalse)
+      ++Removed;
+    else
+      prune(Node.getBody());
+
+    // Drop the elif arms that are never taken. One that is always taken
+    // becomes the else branch, and the arms after it are dropped.
+    Body *Taken = nullptr;
+    unsigned W = 0;
+    for (elifStmt *E : Elifs) {
+      if (Taken) {
+        ++Removed;
+        continue;
+      }
+      E->getCond()->accept(*this);
+      CondKind ElifCond = Cond;
+      if (ElifCond == AlwaysFalse) {
+        ++Removed;
+        continue;
+      }
+      // Pruning the body may evaluate other conditions
+      prune(E->getBody());
+      if (ElifCond == AlwaysTrue)
+        Taken = &E->getBody();
+      else
+        Elifs[W++] = E;
+    }
+    Elifs.truncate(W);
+    if (Taken) {
+      Removed += Node.beginElse() != Node.endElse();
+      Node.getElse().swap(*Taken);
+    }
+    else
+      prune(Node.getElse());
+
+    if (IfCond != AlwaysFalse)
+      return;
+    if (Elifs.empty()) {
+      // No condition is left to test; only the else branch remains, if any
+      splice(Node.getElse());
+      return;
+    }
+    // The first elif left takes the place of the if arm
+    Node.setCond(Elifs.front()->getCond());
+    Node.getBody().swap(Elifs.front()->getBody());
+    Elifs.erase(Elifs.begin());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    prune(Node.getBody());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    Node.getCond()->accept(*this);
+    bool CondKnown = Known;
+    int32_t CondVal = Val;
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+    if (!CondKnown)
+      return;
+
+    // Only the arm entered and the ones it falls through to are run
+    llvm::SmallVector<CaseStmt *>::const_iterator I = Node.findArm(CondVal), E = Node.end();
+    Removed += I - Node.begin();
+    if (I == E) {
+      Result = Drop;
+      return;
+    }
+    Body &Entered = (*I)->getBody();
+    for (++I; I != E; ++I)
+      Entered.append((*I)->begin(), (*I)->end());
+    splice(Entered);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    prune(Node.getBody());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    Node.getCond()->accept(*this);
+    if (Cond == AlwaysFalse) {
+      Result = Drop;
+      return;
+    }
+    prune(Node.getBody());
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    Assignment *First = Node.getFirst();
+    if (First->getAssignKind() == Assignment::Assign && First->getRightExpr()) {
+      First->getRightExpr()->accept(*this);
+      HasLoopVar = Known;
+      LoopVar = First->getLeft()->getRef();
+      LoopVal = Val;
+    }
+    Node.getSecond()->accept(*this);
+    HasLoopVar = false;
+    if (Cond == AlwaysFalse) {
+      // Only the initialization is executed
+      Replacement = First;
+      Result = Replace;
+      return;
+    }
+    prune(Node.getBody());
+  };
+};
+
+// Finds the assignments and declared variables whose value may reach a print
+// or a condition. Each of them is a definition that writes some variables and
+// reads others; prints and conditions are roots. A definition is live if it
+// writes a live variable, and all variables it touches are live then.
+class Liveness : public ASTVisitor {
+  struct Def {
+    llvm::SmallVector<unsigned, 2> Targets; // Variables written, including by ++ and --
+    llvm::SmallVector<unsigned, 4> Reads;   // Variables read
+    bool Live;
+  };
+
+  llvm::SmallVector<Def> Defs;
+  llvm::DenseMap<std::pair<AST *, unsigned>, unsigned> DefIds; // By statement and declared index
+  llvm::DenseMap<unsigned, llvm::SmallVector<unsigned, 2>> DefsOf; // By variable written
+  llvm::DenseSet<unsigned> LiveVars;
+  llvm::SmallVector<unsigned> Worklist;
+  Def Cur;   // The variables touched by the expressions walked since the last definition
+  AST *Stmt; // The statement being walked
+
+  void markVar(unsigned K) {
+    if (LiveVars.insert(K).second)
+      Worklist.push_back(K);
+  }
+
+  void addDef(AST *Node, unsigned Idx) {
+    unsigned Id = Defs.size();
+    Cur.Live = false;
+    Defs.push_back(Cur);
+    DefIds[{Node, Idx}] = Id;
+    for (unsigned K : Cur.Targets)
+      DefsOf[K].push_back(Id);
+    Cur.Targets.clear();
+    Cur.Reads.clear();
+  }
+
+  // The expressions walked since the last definition are always evaluated
+  void addRoot() {
+    for (unsigned K : Cur.Targets)
+      markVar(K);
+    for (unsigned K : Cur.Reads)
+      markVar(K);
+    Cur.Targets.clear();
+    Cur.Reads.clear();
+  }
+
+  void walkBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I) {
+      Stmt = *I;
+      (*I)->accept(*this);
+    }
+  }
+
+public:
+  Liveness() : Stmt(nullptr) {}
+
+  void solve() {
+    while (!Worklist.empty()) {
+      llvm::DenseMap<unsigned, llvm::SmallVector<unsigned, 2>>::iterator I = DefsOf.find(Worklist.pop_back_val());
+      if (I == DefsOf.end())
+        continue;
+      for (unsigned Id : I->second) {
+        Def &D = Defs[Id];
+        if (D.Live)
+          continue;
+        D.Live = true;
+        for (unsigned K : D.Targets)
+          markVar(K);
+        for (unsigned K : D.Reads)
+          markVar(K);
+      }
+    }
+  }
+
+  bool isLive(AST *Node, unsigned Idx) {
+    llvm::DenseMap<std::pair<AST *, unsigned>, unsigned>::iterator I = DefIds.find({Node, Idx});
+    return I == DefIds.end() || Defs[I->second].Live;
+  }
+
+  virtual void visit(Program &Node) override {
+    walkBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &Node) override {
+    if (Node.getKind() == Final::Ident)
+      Cur.Reads.push_back(key(Node.getRef()));
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    Cur.Reads.push_back(key(Node.getRef()));
+    Cur.Targets.push_back(key(Node.getRef()));
+    if (&Node == Stmt)
+      addDef(&Node, 0);
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    Node.getExpr()->accept(*this);
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    Node.getLeft()->accept(*this);
+    Node.getRight()->accept(*this);
+  };
+
+  virtual void visit(Comparison &Node) override {
+    if (Node.getLeft())
+      Node.getLeft()->accept(*this);
+    if (Node.getRight())
+      Node.getRight()->accept(*this);
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    Node.getLeft()->accept(*this);
+    if (Node.getRight())
+      Node.getRight()->accept(*this);
+  };
+
+  virtual void visit(Assignment &Node) override {
+    if (Node.getRightExpr())
+      Node.getRightExpr()->accept(*this);
+    else
+      Node.getRightLogic()->accept(*this);
+    if (Node.getAssignKind() != Assignment::Assign)
+      Cur.Reads.push_back(key(Node.getLeft()->getRef()));
+    Cur.Targets.push_back(key(Node.getLeft()->getRef()));
+    // The initialization and step of a for loop stay with the loop
+    if (&Node == Stmt)
+      addDef(&Node, 0);
+    else
+      addRoot();
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    unsigned I = 0;
+    for (llvm::SmallVector<Expr *>::const_iterator V = Node.valBegin(), E = Node.valEnd(); V != E; ++V, ++I) {
+      if (*V)
+        (*V)->accept(*this);
+      Cur.Targets.push_back(key(Node.getRef(I)));
+      addDef(&Node, I);
+    }
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    unsigned I = 0;
+    for (llvm::SmallVector<Logic *>::const_iterator V = Node.valBegin(), E = Node.valEnd(); V != E; ++V, ++I) {
+      if (*V)
+        (*V)->accept(*this);
+      Cur.Targets.push_back(key(Node.getRef(I)));
+      addDef(&Node, I);
+    }
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+    markVar(key(Node.getRef()));
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    Node.getCond()->accept(*this);
+    addRoot();
+    walkBody(Node.begin(), Node.end());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    walkBody(Node.beginElse(), Node.endElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    Node.getCond()->accept(*this);
+    addRoot();
+    walkBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    Node.getCond()->accept(*this);
+    addRoot();
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    walkBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    Node.getCond()->accept(*this);
+    addRoot();
+    walkBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    Node.getFirst()->accept(*this);
+    Node.getSecond()->accept(*this);
+    addRoot();
+    if (Node.getThirdAssign())
+      Node.getThirdAssign()->accept(*this);
+    else {
+      Node.getThirdUnary()->accept(*this);
+      addRoot();
+    }
+    walkBody(Node.begin(), Node.end());
+  };
+};
+
+// Removes the definitions Liveness found dead.
+class Sweeper : public ASTVisitor {
+  Liveness &Live;
+  bool Dead; // Whether the statement visited last is to be removed
+  unsigned Removed;
+
+  void sweep(Body &Stmts) {
+    llvm::erase_if(Stmts, [this](AST *S) {
+      Dead = false;
+      S->accept(*this);
+      Removed += Dead;
+      return Dead;
+    });
+  }
+
+public:
+  Sweeper(Liveness &Live) : Live(Live), Dead(false), Removed(0) {}
+
+  unsigned getRemoved() { return Removed; }
+
+  virtual void visit(Program &Node) override {
+    sweep(Node.getBody());
+  };
+
+  virtual void visit(Final &Node) override {
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    Dead = !Live.isLive(&Node, 0);
+  };
+
+  virtual void visit(NegExpr &Node) override {
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+  };
+
+  virtual void visit(Comparison &Node) override {
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+  };
+
+  virtual void visit(Assignment &Node) override {
+    Dead = !Live.isLive(&Node, 0);
+  };
+
+  // A dead variable keeps its declaration but loses its initializer, unless
+  // all variables of the declaration are dead.
+  virtual void visit(DeclarationInt &Node) override {
+    unsigned I = 0, NumDead = 0;
+    for (llvm::SmallVector<Expr *>::const_iterator V = Node.valBegin(), E = Node.valEnd(); V != E; ++V, ++I)
+      NumDead += !Live.isLive(&Node, I);
+    Dead = NumDead == I;
+    if (Dead)
+      return;
+    for (unsigned J = 0; J != I; ++J)
+      if (!Live.isLive(&Node, J)) {
+        Node.setValue(J, nullptr);
+        ++Removed;
+      }
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    unsigned I = 0, NumDead = 0;
+    for (llvm::SmallVector<Logic *>::const_iterator V = Node.valBegin(), E = Node.valEnd(); V != E; ++V, ++I)
+      NumDead += !Live.isLive(&Node, I);
+    Dead = NumDead == I;
+    if (Dead)
+      return;
+    for (unsigned J = 0; J != I; ++J)
+      if (!Live.isLive(&Node, J)) {
+        Node.setValue(J, nullptr);
+        ++Removed;
+      }
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    sweep(Node.getBody());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    sweep(Node.getElse());
+    Dead = false;
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    sweep(Node.getBody());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+    Dead = false;
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    sweep(Node.getBody());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    sweep(Node.getBody());
+    Dead = false;
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    sweep(Node.getBody());
+    Dead = false;
+  };
+};
+}
+
+unsigned DeadCode::eliminate(Program *Tree) {
+  // Prune first, so that the code in removed branches keeps nothing alive.
+  ndce::Pruner P;
+  Tree->accept(P);
+
+  ndce::Liveness L;
+  Tree->accept(L);
+  L.solve();
+  ndce::Sweeper S(L);
+  Tree->accept(S);
+  return P.getRemoved() + S.getRemoved();
+}
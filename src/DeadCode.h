@@ -0,0 +1,21 @@
+#ifndef DEADCODE_H
+#define DEADCODE_H
+
+#include "AST.h"
+#include "PassManager.h"
+
+class DeadCode : public ASTPass
+{
+public:
+  // Removes the arms of branches whose condition is constant, loops that never
+  // run, and the assignments and declarations whose values cannot reach a print
+  // or a condition. Returns the number of statements and arms removed.
+  unsigned eliminate(Program *Tree);
+
+  bool run(Program *Tree) override
+  {
+    eliminate(Tree);
+    return false;
+  }
+};
+#endif
@@ -0,0 +1,255 @@
+#include "DeadInit.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+
+namespace ndi{
+// For every variable, the literal initializers whose value it may still hold
+// at the current point. Variables are keyed by slot and type.
+using InitState = llvm::DenseMap<unsigned, llvm::SmallVector<unsigned, 1>>;
+
+class Analysis : public ASTVisitor {
+  // A literal initializer of a declared variable
+  struct Site {
+    DeclarationInt *IntDecl;
+    DeclarationBool *BoolDecl;
+    unsigned Idx;
+    bool Live; // Whether a read may see the initial value
+  };
+
+  llvm::SmallVector<Site> Sites;
+  // Site numbers by declaration and index, so loop bodies walked again reuse them
+  llvm::DenseMap<std::pair<AST *, unsigned>, unsigned> SiteIds;
+  InitState Cur;  // State at the current point of the walk
+  bool IsLiteral; // Whether the expression visited last is a literal
+
+  static unsigned key(VarRef R) { return R.getSlot() * 2 + R.isBool(); }
+
+  void read(VarRef R) {
+    InitState::iterator I = Cur.find(key(R));
+    if (I != Cur.end())
+      for (unsigned S : I->second)
+        Sites[S].Live = true;
+  }
+
+  void assign(VarRef R) { Cur.erase(key(R)); }
+
+  void declare(VarRef R, bool Literal, DeclarationInt *IntDecl, DeclarationBool *BoolDecl, unsigned Idx) {
+    if (!Literal) {
+      assign(R);
+      return;
+    }
+    AST *Decl = IntDecl ? (AST *)IntDecl : (AST *)BoolDecl;
+    std::pair<llvm::DenseMap<std::pair<AST *, unsigned>, unsigned>::iterator, bool> Id =
+        SiteIds.insert({{Decl, Idx}, (unsigned)Sites.size()});
+    if (Id.second)
+      Sites.push_back({IntDecl, BoolDecl, Idx, false});
+    Cur[key(R)] = {Id.first->second};
+  }
+
+  // Adds the initializers of Src to Dst; returns true if Dst grew
+  static bool merge(InitState &Dst, const InitState &Src) {
+    bool Changed = false;
+    for (const auto &KV : Src) {
+      llvm::SmallVector<unsigned, 1> &D = Dst[KV.first];
+      for (unsigned S : KV.second)
+        if (llvm::find(D, S) == D.end()) {
+          D.push_back(S);
+          Changed = true;
+        }
+    }
+    return Changed;
+  }
+
+  void visitBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+  }
+
+  // Walks one arm of a branch from the current state and merges its outcome into Out
+  void branch(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E, InitState &Out) {
+    InitState Saved = Cur;
+    visitBody(I, E);
+    merge(Out, Cur);
+    Cur = std::move(Saved);
+  }
+
+public:
+  Analysis() : IsLiteral(false) {}
+
+  // Drops the initializers that no read can see and returns their number
+  unsigned removeDead() {
+    unsigned Removed = 0;
+    for (Site &S : Sites) {
+      if (S.Live)
+        continue;
+      if (S.IntDecl)
+        S.IntDecl->setValue(S.Idx, nullptr);
+      else
+        S.BoolDecl->setValue(S.Idx, nullptr);
+      ++Removed;
+    }
+    return Removed;
+  }
+
+  virtual void visit(Program &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &Node) override {
+    IsLiteral = Node.getKind() == Final::Number;
+    if (Node.getKind() == Final::Ident)
+      read(Node.getRef());
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    IsLiteral = true;
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    read(Node.getRef());
+    assign(Node.getRef());
+    IsLiteral = false;
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    Node.getExpr()->accept(*this);
+    IsLiteral = false;
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    Node.getLeft()->accept(*this);
+    Node.getRight()->accept(*this);
+    IsLiteral = false;
+  };
+
+  virtual void visit(Comparison &Node) override {
+    if (Node.getLeft())
+      Node.getLeft()->accept(*this);
+    if (Node.getRight())
+      Node.getRight()->accept(*this);
+    IsLiteral = Node.getOperator() == Comparison::True || Node.getOperator() == Comparison::False;
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    Node.getLeft()->accept(*this);
+    if (Node.getRight()) {
+      // The right operand may be skipped, and with it what it assigns
+      InitState Skipped = Cur;
+      Node.getRight()->accept(*this);
+      merge(Cur, Skipped);
+    }
+    IsLiteral = false;
+  };
+
+  virtual void visit(Assignment &Node) override {
+    if (Node.getRightExpr())
+      Node.getRightExpr()->accept(*this);
+    else
+      Node.getRightLogic()->accept(*this);
+    if (Node.getAssignKind() != Assignment::Assign)
+      read(Node.getLeft()->getRef());
+    assign(Node.getLeft()->getRef());
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    // All initializers are evaluated before any of the variables is stored
+    llvm::SmallVector<bool, 8> Literal;
+    for (llvm::SmallVector<Expr *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I) {
+      IsLiteral = false;
+      if (*I)
+        (*I)->accept(*this);
+      Literal.push_back(*I && IsLiteral);
+    }
+    for (unsigned I = 0, E = Literal.size(); I != E; ++I)
+      declare(Node.getRef(I), Literal[I], &Node, nullptr, I);
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    llvm::SmallVector<bool, 8> Literal;
+    for (llvm::SmallVector<Logic *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I) {
+      IsLiteral = false;
+      if (*I)
+        (*I)->accept(*this);
+      Literal.push_back(*I && IsLiteral);
+    }
+    for (unsigned I = 0, E = Literal.size(); I != E; ++I)
+      declare(Node.getRef(I), Literal[I], nullptr, &Node, I);
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+    read(Node.getRef());
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    // Conditions are tested in order; each arm starts from the state after its test
+    InitState Out;
+    Node.getCond()->accept(*this);
+    branch(Node.begin(), Node.end(), Out);
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I) {
+      (*I)->getCond()->accept(*this);
+      branch((*I)->begin(), (*I)->end(), Out);
+    }
+    if (Node.beginElse() != Node.endElse())
+      branch(Node.beginElse(), Node.endElse(), Out);
+    else
+      merge(Out, Cur);
+    Cur = std::move(Out);
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    // An arm is entered from the dispatch or from the arm before it
+    Node.getCond()->accept(*this);
+    InitState Dispatch = Cur;
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I) {
+      if (I != Node.begin())
+        merge(Cur, Dispatch);
+      (*I)->accept(*this);
+    }
+    // Without a default arm, a value no label matches skips the switch
+    if (!Node.getDefault())
+      merge(Cur, Dispatch);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    // Iterate until the state at the loop header is stable
+    InitState Head = Cur;
+    do {
+      Cur = Head;
+      Node.getCond()->accept(*this);
+      visitBody(Node.begin(), Node.end());
+    } while (merge(Head, Cur));
+    Cur = std::move(Head);
+    Node.getCond()->accept(*this);
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    Node.getFirst()->accept(*this);
+    InitState Head = Cur;
+    do {
+      Cur = Head;
+      Node.getSecond()->accept(*this);
+      visitBody(Node.begin(), Node.end());
+      if (Node.getThirdAssign())
+        Node.getThirdAssign()->accept(*this);
+      else
+        Node.getThirdUnary()->accept(*this);
+    } while (merge(Head, Cur));
+    Cur = std::move(Head);
+    Node.getSecond()->accept(*this);
+  };
+};
+}
+
+unsigned DeadInit::eliminate(Program *Tree) {
+  ndi::Analysis A;
+  Tree->accept(A);
+  return A.removeDead();
+}
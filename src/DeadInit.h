@@ -0,0 +1,21 @@
+#ifndef DEADINIT_H
+#define DEADINIT_H
+
+#include "AST.h"
+#include "PassManager.h"
+
+class DeadInit : public ASTPass
+{
+public:
+  // Runs a definite-assignment analysis over the program and drops literal
+  // initializers of variables that are always assigned again before they are
+  // read, so no store is generated for them. Returns the number dropped.
+  unsigned eliminate(Program *Tree);
+
+  bool run(Program *Tree) override
+  {
+    eliminate(Tree);
+    return false;
+  }
+};
+#endif
@@ -0,0 +1,476 @@
+#include "Incremental.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/iterator_range.h"
+#include "llvm/Support/xxhash.h"
+#include <algorithm>
+
+namespace ninc{
+// Deletes a tree made by the parser, which gives every node one parent
+class TreeDeleter : public ASTVisitor {
+  template <typename Range> void dropAll(Range &&R) {
+    for (AST *Node : R)
+      drop(Node);
+  }
+
+public:
+  void drop(AST *Node) {
+    if (!Node)
+      return;
+    Node->accept(*this);
+    delete Node;
+  }
+
+  virtual void visit(Program &Node) override { dropAll(Node.getBody()); };
+  virtual void visit(DeclarationInt &Node) override { dropAll(llvm::make_range(Node.valBegin(), Node.valEnd())); };
+  virtual void visit(DeclarationBool &Node) override { dropAll(llvm::make_range(Node.valBegin(), Node.valEnd())); };
+  virtual void visit(Final &) override {};
+  virtual void visit(BinaryOp &Node) override {
+    drop(Node.getLeft());
+    drop(Node.getRight());
+  };
+  virtual void visit(UnaryOp &) override {};
+  virtual void visit(SignedNumber &) override {};
+  virtual void visit(NegExpr &Node) override { drop(Node.getExpr()); };
+  virtual void visit(Assignment &Node) override {
+    drop(Node.getLeft());
+    drop(Node.getRightExpr());
+    drop(Node.getRightLogic());
+  };
+  virtual void visit(Comparison &Node) override {
+    drop(Node.getLeft());
+    drop(Node.getRight());
+  };
+  virtual void visit(LogicalExpr &Node) override {
+    drop(Node.getLeft());
+    drop(Node.getRight());
+  };
+  virtual void visit(IfStmt &Node) override {
+    drop(Node.getCond());
+    dropAll(Node.getBody());
+    dropAll(Node.getElifs());
+    dropAll(Node.getElse());
+  };
+  virtual void visit(elifStmt &Node) override {
+    drop(Node.getCond());
+    dropAll(Node.getBody());
+  };
+  virtual void visit(WhileStmt &Node) override {
+    drop(Node.getCond());
+    dropAll(Node.getBody());
+  };
+  virtual void visit(ForStmt &Node) override {
+    drop(Node.getFirst());
+    drop(Node.getSecond());
+    drop(Node.getThirdAssign());
+    drop(Node.getThirdUnary());
+    dropAll(Node.getBody());
+  };
+  virtual void visit(PrintStmt &) override {};
+  virtual void visit(SwitchStmt &Node) override {
+    drop(Node.getCond());
+    dropAll(Node.getCases());
+  };
+  virtual void visit(CaseStmt &Node) override {
+    drop(Node.getValue());
+    dropAll(Node.getBody());
+  };
+};
+
+// A region parsed on its own
+struct ParsedStmt
+{
+  unsigned Id;
+  uint64_t Hash;
+  std::string Text; // The tree points into this copy
+  Program *Tree;    // Owned; null if the region has syntax errors
+  llvm::SmallVector<llvm::StringRef> Names; // Identifiers in the order they first appear
+  llvm::SmallVector<std::pair<llvm::StringRef, VarRef::VarType>> Declares; // Top-level variables declared
+  unsigned LastUse;
+
+  ParsedStmt() : Tree(nullptr) {}
+  ~ParsedStmt() { TreeDeleter().drop(Tree); }
+};
+
+// A statement checked and generated with the types its names had
+struct CheckedStmt
+{
+  unsigned ParsedId;
+  llvm::SmallVector<VarRef::VarType> Types; // Of the names of the statement, Unresolved if not declared
+  std::string Diags;
+  bool HasError;
+  std::string Function; // Name of the function running the statement
+  std::string IR;
+  unsigned LastUse;
+  unsigned LastPrinted;
+};
+
+// Collects the variables declared by top-level statements, with the storage
+// Sema gave them
+class TopDecls : public ASTVisitor {
+  llvm::SmallVectorImpl<std::pair<llvm::StringRef, VarRef>> &Found;
+
+public:
+  TopDecls(llvm::SmallVectorImpl<std::pair<llvm::StringRef, VarRef>> &Found) : Found(Found) {}
+
+  virtual void visit(Program &Node) override {
+    for (llvm::SmallVector<AST *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I)
+      Found.push_back({Node.varBegin()[I], VarRef(VarRef::Int, Node.getRef(I).getSlot())});
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I)
+      Found.push_back({Node.varBegin()[I], VarRef(VarRef::Bool, Node.getRef(I).getSlot())});
+  };
+
+  // Nothing else declares a top-level variable
+  virtual void visit(Final &) override {};
+  virtual void visit(BinaryOp &) override {};
+  virtual void visit(UnaryOp &) override {};
+  virtual void visit(SignedNumber &) override {};
+  virtual void visit(NegExpr &) override {};
+  virtual void visit(Assignment &) override {};
+  virtual void visit(Comparison &) override {};
+  virtual void visit(LogicalExpr &) override {};
+  virtual void visit(IfStmt &) override {};
+  virtual void visit(elifStmt &) override {};
+  virtual void visit(WhileStmt &) override {};
+  virtual void visit(ForStmt &) override {};
+  virtual void visit(PrintStmt &) override {};
+  virtual void visit(SwitchStmt &) override {};
+  virtual void visit(CaseStmt &) override {};
+};
+
+// Lexes the region starting at the next token: a top-level statement, which
+// ends with a semicolon or a closing brace outside of parentheses and braces
+// unless an else follows, or a comment between statements. Returns false at
+// the end of the input.
+static bool nextRegion(Lexer &Lex, const char *&Begin, const char *&End)
+{
+  Token Tok;
+  Lex.next(Tok);
+  if (Tok.is(Token::eoi))
+    return false;
+  Begin = Tok.getText().begin();
+  bool CommentOnly = Tok.is(Token::start_comment);
+  bool InComment = false;
+  int Braces = 0, Parens = 0;
+  for (;;)
+  {
+    End = Tok.getText().end();
+    bool Ends = false;
+    if (InComment)
+    {
+      InComment = !Tok.is(Token::end_comment);
+      Ends = !InComment && CommentOnly;
+    }
+    else
+    {
+      switch (Tok.getKind())
+      {
+      case Token::start_comment:
+        InComment = true;
+        break;
+      case Token::l_paren:
+      case Token::minus_paren:
+        ++Parens;
+        break;
+      case Token::r_paren:
+        --Parens;
+        break;
+      case Token::l_brace:
+        ++Braces;
+        break;
+      case Token::r_brace:
+        Ends = --Braces <= 0 && Parens <= 0;
+        break;
+      case Token::semicolon:
+        Ends = Braces <= 0 && Parens <= 0;
+        break;
+      default:
+        break;
+      }
+    }
+    if (Ends && Tok.is(Token::r_brace) && Braces == 0)
+    {
+      // An else continues the if
+      const char *After = Lex.getBuffer();
+      Lex.next(Tok);
+      if (Tok.is(Token::KW_else))
+        continue;
+      Lex.setBufferPtr(After);
+    }
+    if (Ends)
+      return true;
+    Lex.next(Tok);
+    if (Tok.is(Token::eoi))
+      return true;
+  }
+}
+}
+
+using namespace ninc;
+
+// The caches keep at least this many results of earlier versions, so the
+// sweeps of a small program stay rare
+static const size_t MinStaleResults = 1024;
+
+IncrementalCompiler::IncrementalCompiler() : Generation(0), NumParses(0), NumFunctions(0), NumGlobals(0), Last() {}
+
+IncrementalCompiler::~IncrementalCompiler() {}
+
+void IncrementalCompiler::updateRegions(std::string &NewSource)
+{
+  // The edit replaced Source[Prefix, OldEnd) with NewSource[Prefix, NewEnd)
+  size_t Common = std::min(Source.size(), NewSource.size());
+  size_t Prefix = std::mismatch(Source.begin(), Source.begin() + Common, NewSource.begin()).first - Source.begin();
+  size_t Suffix = 0;
+  while (Suffix < Common - Prefix && Source[Source.size() - 1 - Suffix] == NewSource[NewSource.size() - 1 - Suffix])
+    ++Suffix;
+  size_t OldEnd = Source.size() - Suffix;
+  size_t Shift = NewSource.size() - Source.size(); // Modulo 2^64
+
+  // Lexing starts one region before the first one the edit reaches, as an
+  // else added after an if joins it
+  size_t First = std::lower_bound(Regions.begin(), Regions.end(), Prefix,
+                                  [](const Region &R, size_t P) { return R.Offset + R.Length < P; }) -
+                 Regions.begin();
+  if (First > 0)
+    --First;
+  size_t Start = First == 0 ? 0 : Regions[First].Offset;
+
+  // It stops at the start of a region after the edit, from where the text and
+  // so the regions are the same as before
+  size_t Sync = First + 1;
+  while (Sync < Regions.size() && Regions[Sync].Offset < OldEnd)
+    ++Sync;
+  std::vector<Region> Lexed;
+  Lexer Lex(llvm::StringRef(NewSource.data() + Start, NewSource.size() - Start));
+  const char *Begin, *End = NewSource.data() + Start;
+  bool Synced = false;
+  while (!Synced && nextRegion(Lex, Begin, End))
+  {
+    Region R;
+    R.Offset = Begin - NewSource.data();
+    R.Length = End - Begin;
+    R.Hash = llvm::xxHash64(llvm::StringRef(Begin, R.Length));
+    Lexed.push_back(R);
+
+    const char *After = Lex.getBuffer();
+    Token Next;
+    Lex.next(Next);
+    Lex.setBufferPtr(After);
+    if (Next.is(Token::eoi))
+      break;
+    size_t NextOffset = Next.getText().begin() - NewSource.data();
+    while (Sync < Regions.size() && Regions[Sync].Offset + Shift < NextOffset)
+      ++Sync;
+    Synced = Sync < Regions.size() && Regions[Sync].Offset + Shift == NextOffset;
+  }
+  Last.LexedBytes = End - (NewSource.data() + Start);
+
+  if (!Synced)
+    Sync = Regions.size();
+  Regions.erase(Regions.begin() + First, Regions.begin() + Sync);
+  Regions.insert(Regions.begin() + First, Lexed.begin(), Lexed.end());
+  for (size_t I = First + Lexed.size(), E = Regions.size(); I != E; ++I)
+    Regions[I].Offset += Shift;
+  Source.swap(NewSource);
+}
+
+ParsedStmt *IncrementalCompiler::parse(const Region &R)
+{
+  llvm::StringRef Text(Source.data() + R.Offset, R.Length);
+  std::unique_ptr<ParsedStmt> &Entry = Parses[R.Hash];
+  if (Entry && Entry->Text == Text)
+  {
+    Entry->LastUse = Generation;
+    return Entry.get();
+  }
+
+  std::unique_ptr<ParsedStmt> Parsed(new ParsedStmt);
+  Parsed->Id = ++NumParses;
+  Parsed->Hash = R.Hash;
+  Parsed->Text = Text.str();
+  Parsed->LastUse = Generation;
+  Lexer Lex(Parsed->Text);
+  Parser P(Lex);
+  Program *Tree = P.parse();
+  if (P.hasError())
+    TreeDeleter().drop(Tree);
+  else
+    Parsed->Tree = Tree;
+  ++Last.Parsed;
+
+  // The statement depends on the declarations of the names it mentions
+  Lexer Names(Parsed->Text);
+  llvm::StringSet<> Seen;
+  Token Tok;
+  for (Names.next(Tok); !Tok.is(Token::eoi); Names.next(Tok))
+    if (Tok.is(Token::ident) && Seen.insert(Tok.getText()).second)
+      Parsed->Names.push_back(Tok.getText());
+  if (Parsed->Tree)
+  {
+    llvm::SmallVector<std::pair<llvm::StringRef, VarRef>> Declared;
+    TopDecls Decls(Declared);
+    Parsed->Tree->accept(Decls);
+    for (std::pair<llvm::StringRef, VarRef> D : Declared)
+      Parsed->Declares.push_back({D.first, D.second.getType()});
+  }
+
+  // Another region of this program may have the same hash
+  if (Entry && Entry->LastUse == Generation)
+  {
+    UncachedParses.push_back(std::move(Parsed));
+    return UncachedParses.back().get();
+  }
+  Entry = std::move(Parsed);
+  return Entry.get();
+}
+
+CheckedStmt *IncrementalCompiler::check(ParsedStmt *Parsed, llvm::ArrayRef<VarRef::VarType> Types)
+{
+  uint64_t Key = llvm::hash_combine(Parsed->Hash, llvm::hash_combine_range(Types.begin(), Types.end()));
+  std::unique_ptr<CheckedStmt> &Entry = Checks[Key];
+  if (Entry && Entry->ParsedId == Parsed->Id && llvm::ArrayRef<VarRef::VarType>(Entry->Types) == Types)
+  {
+    Entry->LastUse = Generation;
+    return Entry.get();
+  }
+
+  std::unique_ptr<CheckedStmt> Checked(new CheckedStmt);
+  Checked->ParsedId = Parsed->Id;
+  Checked->Types.assign(Types.begin(), Types.end());
+  Checked->LastUse = Generation;
+  Checked->LastPrinted = 0;
+  ++Last.Checked;
+
+  llvm::SmallVector<std::pair<llvm::StringRef, VarRef::VarType>> Visible;
+  for (unsigned I = 0, E = Types.size(); I != E; ++I)
+    if (Types[I] != VarRef::Unresolved)
+      Visible.push_back({Parsed->Names[I], Types[I]});
+  llvm::raw_string_ostream Diag(Checked->Diags);
+  Sema Semantic;
+  Checked->HasError = Semantic.semanticStatement(Parsed->Tree, Visible, Diag);
+  Diag.flush();
+  if (!Checked->HasError)
+  {
+    // Sema gives the visible variables the first slots of their type, in order
+    llvm::SmallVector<std::pair<llvm::StringRef, VarRef>> Globals;
+    unsigned NumInt = 0, NumBool = 0;
+    for (const std::pair<llvm::StringRef, VarRef::VarType> &V : Visible)
+      Globals.push_back({V.first, VarRef(V.second, V.second == VarRef::Bool ? NumBool++ : NumInt++)});
+    TopDecls Decls(Globals);
+    Parsed->Tree->accept(Decls);
+    Checked->Function = "s" + llvm::utostr(++NumFunctions);
+    Checked->IR = Chunks.emit(Parsed->Tree, Checked->Function, Globals);
+  }
+
+  // Another statement of this program may have the same key
+  if (Entry && Entry->LastUse == Generation)
+  {
+    UncachedChecks.push_back(std::move(Checked));
+    return UncachedChecks.back().get();
+  }
+  Entry = std::move(Checked);
+  return Entry.get();
+}
+
+bool IncrementalCompiler::update(llvm::StringRef NewSource, llvm::raw_ostream &Out, llvm::raw_ostream &Diag)
+{
+  ++Generation;
+  Last = Stats();
+  UncachedParses.clear();
+  UncachedChecks.clear();
+  std::string Text = NewSource.str();
+  updateRegions(Text);
+  Last.Statements = Regions.size();
+
+  // The top-level variables are visible from the statement after their
+  // declaration on
+  llvm::StringMap<VarRef::VarType> Declared(NumGlobals);
+  llvm::SmallVector<std::pair<llvm::StringRef, VarRef>> Globals;
+  llvm::SmallVector<llvm::StringRef> Functions, Calls;
+  llvm::SmallVector<VarRef::VarType> Types;
+  Globals.reserve(NumGlobals);
+  Functions.reserve(Regions.size());
+  Calls.reserve(Regions.size());
+  bool SyntaxError = false, SemaError = false;
+  for (const Region &R : Regions)
+  {
+    ParsedStmt *Parsed = parse(R);
+    if (!Parsed->Tree)
+    {
+      SyntaxError = true;
+      continue;
+    }
+    if (Parsed->Tree->begin() == Parsed->Tree->end())
+      continue;
+
+    Types.clear();
+    for (llvm::StringRef Name : Parsed->Names)
+    {
+      llvm::StringMap<VarRef::VarType>::const_iterator I = Declared.find(Name);
+      Types.push_back(I == Declared.end() ? VarRef::Unresolved : I->second);
+    }
+    CheckedStmt *Checked = check(Parsed, Types);
+    if (Checked->HasError)
+    {
+      Diag << Checked->Diags;
+      SemaError = true;
+    }
+    else
+    {
+      // Equal statements with equal types share their function
+      if (Checked->LastPrinted != Generation)
+        Functions.push_back(Checked->IR);
+      Checked->LastPrinted = Generation;
+      Calls.push_back(Checked->Function);
+    }
+
+    for (const std::pair<llvm::StringRef, VarRef::VarType> &D : Parsed->Declares)
+    {
+      std::pair<llvm::StringMap<VarRef::VarType>::iterator, bool> Inserted = Declared.insert({D.first, D.second});
+      if (Inserted.second)
+        Globals.push_back({Inserted.first->getKey(), VarRef(D.second, 0)});
+    }
+  }
+
+  NumGlobals = Globals.size();
+
+  // Results of earlier versions not used by this one are dropped once a cache
+  // holds more of them than there are statements, and more than
+  // MinStaleResults; this keeps the sweeps from costing more than the updates
+  // that fill the caches. This version uses at most one result per statement.
+  size_t MaxCached = Regions.size() + std::max(Regions.size(), MinStaleResults);
+  if (Parses.size() > MaxCached || Checks.size() > MaxCached)
+  {
+    for (std::unordered_map<uint64_t, std::unique_ptr<ParsedStmt>>::iterator I = Parses.begin(); I != Parses.end();)
+      I = I->second->LastUse == Generation ? std::next(I) : Parses.erase(I);
+    for (std::unordered_map<uint64_t, std::unique_ptr<CheckedStmt>>::iterator I = Checks.begin(); I != Checks.end();)
+      I = I->second->LastUse == Generation ? std::next(I) : Checks.erase(I);
+  }
+
+  if (SyntaxError)
+  {
+    Diag << "Syntax errors occurred\n";
+    return true;
+  }
+  if (SemaError)
+  {
+    Diag << "Semantic errors occurred\n";
+    return true;
+  }
+  ChunkCodeGen::printModule(Out, Globals, Functions, Calls);
+  return false;
+}
@@ -0,0 +1,85 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "CodeGen.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ninc {
+struct ParsedStmt;
+struct CheckedStmt;
+}
+
+// IncrementalCompiler compiles successive versions of a program, such as the
+// buffer of an editor, reusing what it computed for the previous version. The
+// pipeline is split into memoized queries, each keyed by the hashes of its
+// inputs:
+//  - the regions of the source holding one top-level statement each, found by
+//    lexing; after an edit only the text from the region before the edit to
+//    the first unchanged region boundary after it is lexed again;
+//  - the tree of a region, keyed by the hash of its text;
+//  - the top-level variables visible to a statement, from the declarations of
+//    the statements before it;
+//  - the checked statement and its code, keyed by the hash of its text and the
+//    types of the visible variables it names.
+// Only the statements whose text or visible variables changed are parsed,
+// checked and generated again. The AST passes and the LLVM pipeline look at
+// the whole program, so they are not run.
+class IncrementalCompiler
+{
+public:
+  // What the last update had to compute again
+  struct Stats
+  {
+    unsigned Statements; // Regions of the program
+    size_t LexedBytes;   // Source lexed to find the regions
+    unsigned Parsed;     // Regions parsed
+    unsigned Checked;    // Statements checked and generated
+  };
+
+private:
+  struct Region
+  {
+    size_t Offset;
+    size_t Length;
+    uint64_t Hash;
+  };
+
+  std::string Source;
+  std::vector<Region> Regions;
+  std::unordered_map<uint64_t, std::unique_ptr<ninc::ParsedStmt>> Parses;
+  std::unordered_map<uint64_t, std::unique_ptr<ninc::CheckedStmt>> Checks;
+  // Results whose key collided with another result of the same update
+  std::vector<std::unique_ptr<ninc::ParsedStmt>> UncachedParses;
+  std::vector<std::unique_ptr<ninc::CheckedStmt>> UncachedChecks;
+  ChunkCodeGen Chunks;
+  unsigned Generation;
+  unsigned NumParses;
+  unsigned NumFunctions;
+  unsigned NumGlobals; // Of the last update, to size the tables of the next one
+  Stats Last;
+
+  // Lexes NewSource from the start of the region before the edit, replaces
+  // the regions that changed and takes NewSource as the source
+  void updateRegions(std::string &NewSource);
+
+  ninc::ParsedStmt *parse(const Region &R);
+
+  ninc::CheckedStmt *check(ninc::ParsedStmt *Parsed, llvm::ArrayRef<VarRef::VarType> Types);
+
+public:
+  IncrementalCompiler();
+  ~IncrementalCompiler();
+
+  // Compiles NewSource and prints the module to Out. Returns true and reports
+  // to Diag if the program has errors.
+  bool update(llvm::StringRef NewSource, llvm::raw_ostream &Out, llvm::raw_ostream &Diag);
+
+  const Stats &getStats() { return Last; }
+};
+#endif
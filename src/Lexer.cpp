@@ -23,7 +23,7 @@ namespace charinfo
 
     LLVM_READNONE inline bool isSpecialCharacter(char c)
     {
-        return c == '=' || c == '+' || c == '-' || c == '*' || c == '/' || c == '!' || c == '>' || c == '<' || c == '(' || c == ')' || c == '{' || c == '}'|| c == ',' || c == ';' || c == '%' || c == '^';
+        return c == '=' || c == '+' || c == '-' || c == '*' || c == '/' || c == '!' || c == '>' || c == '<' || c == '(' || c == ')' || c == '{' || c == '}'|| c == ',' || c == ';' || c == '%' || c == '^' || c == ':';
     }
 }
 
@@ -233,6 +233,11 @@ void Lexer::next(Token &token) {
     return;
 }
 
+void Lexer::skipToEnd(Token &token) {
+    BufferPtr = BufferEnd;
+    token.Kind = Token::eoi;
+}
+
 void Lexer::setBufferPtr(const char *buffer){
     BufferPtr = buffer;
 }
@@ -93,15 +93,18 @@ class Lexer
 {
     const char *BufferStart; // pointer to the beginning of the input
     const char *BufferPtr;   // pointer to the next unprocessed character
+    const char *BufferEnd;   // pointer to the end of the input
 
 public:
     Lexer(const llvm::StringRef &Buffer)
     {
         BufferStart = Buffer.begin();
         BufferPtr = BufferStart;
+        BufferEnd = BufferStart + std::min(Buffer.find('\0'), Buffer.size());
     }
 
     void next(Token &token); // return the next token
+    void skipToEnd(Token &token); // return the end of input without lexing what is left
     void setBufferPtr(const char* buffer);
     const char* getBuffer(){return BufferPtr;};
 
@@ -0,0 +1,313 @@
+#include "LoopEffects.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace nloop{
+class Shape : public ASTVisitor {
+  llvm::raw_ostream &OS;
+
+  void shape(AST *Node) {
+    if (Node)
+      Node->accept(*this);
+    else
+      OS << "_";
+  }
+
+public:
+  Shape(llvm::raw_ostream &OS) : OS(OS) {}
+
+  virtual void visit(Final &Node) override {
+    if (Node.getKind() == Final::Ident)
+      OS << "v" << key(Node.getRef());
+    else
+      OS << Node.getVal();
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    OS << (Node.getSign() == SignedNumber::Minus ? "-" : "") << Node.getValue();
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    OS << "(u" << Node.getOperator() << " v" << key(Node.getRef()) << ")";
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    OS << "(neg ";
+    shape(Node.getExpr());
+    OS << ")";
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    OS << "(b" << Node.getOperator() << " ";
+    shape(Node.getLeft());
+    OS << " ";
+    shape(Node.getRight());
+    OS << ")";
+  };
+
+  virtual void visit(Comparison &Node) override {
+    OS << "(c" << Node.getOperator() << " ";
+    shape(Node.getLeft());
+    OS << " ";
+    shape(Node.getRight());
+    OS << ")";
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    OS << "(l" << Node.getOperator() << " ";
+    shape(Node.getLeft());
+    OS << " ";
+    shape(Node.getRight());
+    OS << ")";
+  };
+
+  virtual void visit(Assignment &Node) override {
+    OS << "(a" << Node.getAssignKind() << " ";
+    shape(Node.getLeft());
+    OS << " ";
+    shape(Node.getRightExpr());
+    OS << " ";
+    shape(Node.getRightLogic());
+    OS << ")";
+  };
+
+  // Only loop headers are compared
+  virtual void visit(DeclarationInt &) override {};
+  virtual void visit(DeclarationBool &) override {};
+  virtual void visit(IfStmt &) override {};
+  virtual void visit(elifStmt &) override {};
+  virtual void visit(WhileStmt &) override {};
+  virtual void visit(ForStmt &) override {};
+  virtual void visit(PrintStmt &) override {};
+  virtual void visit(SwitchStmt &) override {};
+  virtual void visit(CaseStmt &) override {};
+};
+
+std::string shapeOf(AST *Node) {
+  std::string S;
+  llvm::raw_string_ostream OS(S);
+  Shape Sh(OS);
+  if (Node)
+    Node->accept(Sh);
+  return OS.str();
+}
+
+bool literal(Expr *E, int32_t &Val) {
+  std::string S = shapeOf(E);
+  return !S.empty() && S.find_first_not_of("-0123456789") == std::string::npos && !llvm::StringRef(S).getAsInteger(10, Val);
+}
+
+void Effects::divide(Expr *Divisor) {
+  int32_t Val;
+  if (!literal(Divisor, Val) || Val == 0)
+    MayNotFinish = true;
+}
+
+void Effects::visit(Program &Node) {
+  addBody(Node.begin(), Node.end());
+}
+
+void Effects::visit(Final &Node) {
+  if (Node.getKind() == Final::Ident)
+    Reads.insert(key(Node.getRef()));
+}
+
+void Effects::visit(SignedNumber &) {}
+
+void Effects::visit(UnaryOp &Node) {
+  Reads.insert(key(Node.getRef()));
+  Writes.insert(key(Node.getRef()));
+}
+
+void Effects::visit(NegExpr &Node) {
+  add(Node.getExpr());
+}
+
+void Effects::visit(BinaryOp &Node) {
+  add(Node.getLeft());
+  add(Node.getRight());
+  if (Node.getOperator() == BinaryOp::Div || Node.getOperator() == BinaryOp::Mod)
+    divide(Node.getRight());
+}
+
+void Effects::visit(Comparison &Node) {
+  add(Node.getLeft());
+  add(Node.getRight());
+}
+
+void Effects::visit(LogicalExpr &Node) {
+  add(Node.getLeft());
+  add(Node.getRight());
+}
+
+void Effects::visit(Assignment &Node) {
+  add(Node.getRightExpr());
+  add(Node.getRightLogic());
+  if (Node.getAssignKind() != Assignment::Assign)
+    Reads.insert(key(Node.getLeft()->getRef()));
+  if (Node.getAssignKind() == Assignment::Slash_assign)
+    divide(Node.getRightExpr());
+  Writes.insert(key(Node.getLeft()->getRef()));
+}
+
+void Effects::visit(DeclarationInt &Node) {
+  for (llvm::SmallVector<Expr *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+    add(*I);
+  for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I)
+    Writes.insert(key(Node.getRef(I)));
+}
+
+void Effects::visit(DeclarationBool &Node) {
+  for (llvm::SmallVector<Logic *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+    add(*I);
+  for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I)
+    Writes.insert(key(Node.getRef(I)));
+}
+
+void Effects::visit(PrintStmt &Node) {
+  Reads.insert(key(Node.getRef()));
+  Prints = true;
+}
+
+void Effects::visit(IfStmt &Node) {
+  add(Node.getCond());
+  addBody(Node.begin(), Node.end());
+  for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+    (*I)->accept(*this);
+  addBody(Node.beginElse(), Node.endElse());
+}
+
+void Effects::visit(elifStmt &Node) {
+  add(Node.getCond());
+  addBody(Node.begin(), Node.end());
+}
+
+void Effects::visit(WhileStmt &Node) {
+  MayNotFinish = true;
+  add(Node.getCond());
+  addBody(Node.begin(), Node.end());
+}
+
+void Effects::visit(ForStmt &Node) {
+  MayNotFinish = true;
+  add(Node.getFirst());
+  add(Node.getSecond());
+  add(Node.getThirdAssign());
+  add(Node.getThirdUnary());
+  addBody(Node.begin(), Node.end());
+}
+
+void Effects::visit(SwitchStmt &Node) {
+  add(Node.getCond());
+  for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+    (*I)->accept(*this);
+}
+
+void Effects::visit(CaseStmt &Node) {
+  addBody(Node.begin(), Node.end());
+}
+
+// Looks at the statements of a list in order and at the assignments that run
+// whenever the statement runs
+class Kills : public ASTVisitor {
+  llvm::DenseSet<unsigned> &Killed;
+  llvm::DenseSet<unsigned> ReadBefore; // Variables the statements so far may read
+
+  // The statement assigns Var with a value computed by Value
+  void assign(unsigned Var, AST *Value) {
+    Effects E;
+    if (Value)
+      Value->accept(E);
+    if (!ReadBefore.count(Var) && !E.Reads.count(Var))
+      Killed.insert(Var);
+  }
+
+public:
+  Kills(llvm::DenseSet<unsigned> &Killed) : Killed(Killed) {}
+
+  void scan(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I) {
+      (*I)->accept(*this);
+      Effects Stmt;
+      (*I)->accept(Stmt);
+      ReadBefore.insert(Stmt.Reads.begin(), Stmt.Reads.end());
+    }
+  }
+
+  virtual void visit(Assignment &Node) override {
+    if (Node.getAssignKind() == Assignment::Assign)
+      assign(key(Node.getLeft()->getRef()), Node.getRightExpr() ? (AST *)Node.getRightExpr() : (AST *)Node.getRightLogic());
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    llvm::SmallVector<Expr *>::const_iterator Val = Node.valBegin();
+    for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I, ++Val)
+      if (Val < Node.valEnd() && *Val)
+        assign(key(Node.getRef(I)), *Val);
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    llvm::SmallVector<Logic *>::const_iterator Val = Node.valBegin();
+    for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I, ++Val)
+      if (Val < Node.valEnd() && *Val)
+        assign(key(Node.getRef(I)), *Val);
+  };
+
+  // The first assignment of a for loop always runs
+  virtual void visit(ForStmt &Node) override {
+    Node.getFirst()->accept(*this);
+  };
+
+  // Other statements assign conditionally or not at all
+  virtual void visit(Final &) override {};
+  virtual void visit(SignedNumber &) override {};
+  virtual void visit(UnaryOp &) override {};
+  virtual void visit(NegExpr &) override {};
+  virtual void visit(BinaryOp &) override {};
+  virtual void visit(Comparison &) override {};
+  virtual void visit(LogicalExpr &) override {};
+  virtual void visit(IfStmt &) override {};
+  virtual void visit(elifStmt &) override {};
+  virtual void visit(WhileStmt &) override {};
+  virtual void visit(PrintStmt &) override {};
+  virtual void visit(SwitchStmt &) override {};
+  virtual void visit(CaseStmt &) override {};
+};
+
+void findKilled(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E,
+                llvm::DenseSet<unsigned> &Killed) {
+  Kills(Killed).scan(I, E);
+}
+
+bool matchCountedLoop(ForStmt *L, CountedLoop &Counted) {
+  Counted.IndVar = key(L->getFirst()->getLeft()->getRef());
+  if (L->getThirdUnary())
+    Counted.Step = L->getThirdUnary()->getOperator() == UnaryOp::Plus_plus ? 1 : -1;
+  else {
+    int32_t By;
+    if (!literal(L->getThirdAssign()->getRightExpr(), By) || By == 0)
+      return false;
+    if (L->getThirdAssign()->getAssignKind() == Assignment::Plus_assign)
+      Counted.Step = By;
+    else if (L->getThirdAssign()->getAssignKind() == Assignment::Minus_assign && By != INT32_MIN)
+      Counted.Step = -By;
+    else
+      return false;
+  }
+
+  // Only a comparison has a shape starting with "(c"
+  if (shapeOf(L->getSecond()).compare(0, 2, "(c") != 0)
+    return false;
+  Comparison *Cond = (Comparison *)L->getSecond();
+  if (!Cond->getRight() || shapeOf(Cond->getLeft()) != "v" + std::to_string(Counted.IndVar))
+    return false;
+  Effects Bound;
+  Cond->getRight()->accept(Bound);
+  if (Bound.Reads.count(Counted.IndVar))
+    return false;
+  Counted.Op = Cond->getOperator();
+  Counted.Bound = Cond->getRight();
+  if (Counted.Step > 0)
+    return Counted.Op == Comparison::Less || Counted.Op == Comparison::Less_equal;
+  return Counted.Op == Comparison::Greater || Counted.Op == Comparison::Greater_equal;
+}
+}
@@ -0,0 +1,94 @@
+#ifndef LOOPEFFECTS_H
+#define LOOPEFFECTS_H
+
+#include "AST.h"
+#include "llvm/ADT/DenseSet.h"
+#include <string>
+
+// What the loop transformations need to know about statements: which
+// variables they read and write, and the shape of counted loops.
+namespace nloop{
+// Variables are keyed by slot and type. Sema reuses the slots of ended scopes,
+// so a key can stand for several variables; treating them as one is safe, and
+// it is also how CodeGen stores them.
+inline unsigned key(VarRef R) { return R.getSlot() * 2 + R.isBool(); }
+
+inline VarRef refOf(unsigned Key) { return VarRef(Key & 1 ? VarRef::Bool : VarRef::Int, Key / 2); }
+
+// Writes an expression or an assignment with the storage of its variables
+// instead of their names, so that equal text means the same computation.
+std::string shapeOf(AST *Node);
+
+// Reads the value of an expression that is a literal.
+bool literal(Expr *E, int32_t &Val);
+
+// What running a list of statements or an expression may do: the variables
+// it reads and writes, whether it prints, and whether it may stop the program
+// or never finish, by dividing by zero or in a loop
+class Effects : public ASTVisitor {
+public:
+  llvm::DenseSet<unsigned> Reads;
+  llvm::DenseSet<unsigned> Writes;
+  bool Prints;
+  bool MayNotFinish;
+
+private:
+  void add(AST *Node) {
+    if (Node)
+      Node->accept(*this);
+  }
+
+  void addBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+  }
+
+  // A divisor other than a non-zero literal may trap
+  void divide(Expr *Divisor);
+
+public:
+  Effects() : Prints(false), MayNotFinish(false) {}
+
+  virtual void visit(Program &Node) override;
+  virtual void visit(Final &Node) override;
+  virtual void visit(SignedNumber &) override;
+  virtual void visit(UnaryOp &Node) override;
+  virtual void visit(NegExpr &Node) override;
+  virtual void visit(BinaryOp &Node) override;
+  virtual void visit(Comparison &Node) override;
+  virtual void visit(LogicalExpr &Node) override;
+  virtual void visit(Assignment &Node) override;
+  virtual void visit(DeclarationInt &Node) override;
+  virtual void visit(DeclarationBool &Node) override;
+  virtual void visit(PrintStmt &Node) override;
+  virtual void visit(IfStmt &Node) override;
+  virtual void visit(elifStmt &Node) override;
+  virtual void visit(WhileStmt &Node) override;
+  virtual void visit(ForStmt &Node) override;
+  virtual void visit(SwitchStmt &Node) override;
+  virtual void visit(CaseStmt &Node) override;
+};
+
+// Adds to Killed the variables a statement list always assigns before it
+// reads them, like the induction variables of its loops. Such a variable does
+// not carry a value from one iteration of the loop around the list to the
+// next.
+void findKilled(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E,
+                llvm::DenseSet<unsigned> &Killed);
+
+// A for loop that counts its induction variable by a literal step towards a
+// bound: `i < Bound` or `i <= Bound` going up, `i > Bound` or `i >= Bound`
+// going down. The bound does not read the induction variable, so the loop
+// ends if its body does not change what the bound reads.
+struct CountedLoop
+{
+  unsigned IndVar;
+  int32_t Step;
+  Comparison::Operator Op;
+  Expr *Bound;
+};
+
+// Returns whether the header of L has that shape, and what it counts.
+bool matchCountedLoop(ForStmt *L, CountedLoop &Counted);
+}
+#endif
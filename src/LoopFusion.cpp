@@ -0,0 +1,173 @@
+#include "LoopFusion.h"
+#include "LoopEffects.h"
+
+namespace nfuse{
+using namespace nloop;
+using Body = llvm::SmallVectorImpl<AST *>;
+
+// Whether a variable of A is in B, except the variables in Except
+static bool intersects(const llvm::DenseSet<unsigned> &A, const llvm::DenseSet<unsigned> &B,
+                       const llvm::DenseSet<unsigned> &Except = {}) {
+  for (unsigned K : A)
+    if (B.count(K) && !Except.count(K))
+      return true;
+  return false;
+}
+
+class Fuser : public ASTVisitor {
+  ForStmt *Loop; // The statement visited last if it is a for loop
+  unsigned Fused;
+
+  // Whether the loop is known to end: it counts towards a bound that neither
+  // its body nor the bound itself changes
+  static bool ends(ForStmt *L) {
+    CountedLoop Counted;
+    if (!matchCountedLoop(L, Counted))
+      return false;
+    Effects Inside, Bound;
+    for (llvm::SmallVector<AST *>::const_iterator I = L->begin(), E = L->end(); I != E; ++I)
+      (*I)->accept(Inside);
+    Counted.Bound->accept(Bound);
+    if (!Bound.Writes.empty())
+      return false;
+    for (unsigned K : Bound.Reads)
+      if (Inside.Writes.count(K))
+        return false;
+    return true;
+  }
+
+  // Whether running the body of B right after the body of A in every
+  // iteration computes what running all of A and then all of B computes
+  static bool canFuse(ForStmt *A, ForStmt *B) {
+    AST *Third = A->getThirdAssign() ? (AST *)A->getThirdAssign() : (AST *)A->getThirdUnary();
+    AST *OtherThird = B->getThirdAssign() ? (AST *)B->getThirdAssign() : (AST *)B->getThirdUnary();
+    if (shapeOf(A->getFirst()) != shapeOf(B->getFirst()) || shapeOf(A->getSecond()) != shapeOf(B->getSecond()) ||
+        shapeOf(Third) != shapeOf(OtherThird))
+      return false;
+
+    Effects BodyA, BodyB, Init, Header;
+    for (llvm::SmallVector<AST *>::const_iterator I = A->begin(), E = A->end(); I != E; ++I)
+      (*I)->accept(BodyA);
+    for (llvm::SmallVector<AST *>::const_iterator I = B->begin(), E = B->end(); I != E; ++I)
+      (*I)->accept(BodyB);
+    A->getFirst()->accept(Init);
+    A->getSecond()->accept(Header);
+    Third->accept(Header);
+
+    // Both loops must start at the same value and step the same way through
+    // the same number of iterations. The fused loop runs the header once for
+    // both, so it may only change the induction variable.
+    unsigned IndVar = key(A->getFirst()->getLeft()->getRef());
+    for (unsigned K : Init.Writes)
+      if (K != IndVar)
+        return false;
+    for (unsigned K : Header.Writes)
+      if (K != IndVar)
+        return false;
+    if (Init.Reads.count(IndVar) || BodyA.Writes.count(IndVar) || BodyB.Writes.count(IndVar) ||
+        intersects(Init.Reads, BodyA.Writes) || intersects(Header.Reads, BodyA.Writes) ||
+        intersects(Header.Reads, BodyB.Writes))
+      return false;
+
+    // The bodies must not depend on each other, except through variables both
+    // assign before reading them. The last iteration of B still writes them last.
+    llvm::DenseSet<unsigned> KilledA, KilledB, Private;
+    findKilled(A->begin(), A->end(), KilledA);
+    findKilled(B->begin(), B->end(), KilledB);
+    for (unsigned K : KilledA)
+      if (KilledB.count(K))
+        Private.insert(K);
+    if (intersects(BodyA.Writes, BodyB.Reads, Private) || intersects(BodyA.Writes, BodyB.Writes, Private) ||
+        intersects(BodyB.Writes, BodyA.Reads, Private))
+      return false;
+
+    // Interleaving must not reorder the output, and B must not print before
+    // A stopped the program or looped forever
+    if (BodyA.Prints && (BodyB.Prints || BodyB.MayNotFinish))
+      return false;
+    if (BodyB.Prints && (BodyA.MayNotFinish || Header.MayNotFinish || !ends(A)))
+      return false;
+    return true;
+  }
+
+  void fuseBody(Body &Stmts) {
+    unsigned W = 0;
+    ForStmt *Prev = nullptr; // The statement at W - 1 if it is a for loop
+    for (unsigned R = 0; R != Stmts.size(); ++R) {
+      AST *S = Stmts[R];
+      Loop = nullptr;
+      S->accept(*this);
+      if (Prev && Loop && canFuse(Prev, Loop)) {
+        // Loops at the end of the first body and the start of the second one
+        // are now adjacent
+        Body &Merged = Prev->getBody();
+        Merged.append(Loop->begin(), Loop->end());
+        fuseBody(Merged);
+        ++Fused;
+        continue;
+      }
+      Stmts[W++] = S;
+      Prev = Loop;
+    }
+    Stmts.resize(W);
+    Loop = nullptr;
+  }
+
+public:
+  Fuser() : Loop(nullptr), Fused(0) {}
+
+  unsigned getFused() { return Fused; }
+
+  virtual void visit(Program &Node) override {
+    fuseBody(Node.getBody());
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    fuseBody(Node.getBody());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    fuseBody(Node.getElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    fuseBody(Node.getBody());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    fuseBody(Node.getBody());
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    fuseBody(Node.getBody());
+    Loop = &Node;
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    fuseBody(Node.getBody());
+  };
+
+  // Only statement lists hold loops
+  virtual void visit(Final &) override {};
+  virtual void visit(SignedNumber &) override {};
+  virtual void visit(UnaryOp &) override {};
+  virtual void visit(NegExpr &) override {};
+  virtual void visit(BinaryOp &) override {};
+  virtual void visit(Comparison &) override {};
+  virtual void visit(LogicalExpr &) override {};
+  virtual void visit(Assignment &) override {};
+  virtual void visit(DeclarationInt &) override {};
+  virtual void visit(DeclarationBool &) override {};
+  virtual void visit(PrintStmt &) override {};
+};
+}
+
+unsigned LoopFusion::fuse(Program *Tree) {
+  nfuse::Fuser F;
+  Tree->accept(F);
+  return F.getFused();
+}
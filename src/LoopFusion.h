@@ -0,0 +1,21 @@
+#ifndef LOOPFUSION_H
+#define LOOPFUSION_H
+
+#include "AST.h"
+#include "PassManager.h"
+
+class LoopFusion : public ASTPass
+{
+public:
+  // Merges adjacent for loops with the same header into one loop when the
+  // header does not depend on their bodies and neither body reads or writes
+  // what the other one writes. Returns the number of loops merged away.
+  unsigned fuse(Program *Tree);
+
+  bool run(Program *Tree) override
+  {
+    fuse(Tree);
+    return false;
+  }
+};
+#endif
@@ -0,0 +1,292 @@
+#include "ParallelLoops.h"
+#include "LoopEffects.h"
+#include "llvm/ADT/DenseMap.h"
+#include <cstdlib>
+
+namespace npar{
+using namespace nloop;
+
+// Loops with fewer iterations are not worth waking other threads for
+static const int64_t MinTrips = 10000;
+
+// How the statements of a loop body use a variable
+struct Use
+{
+  bool Other = false;   // Read or written other than by the operators below
+  bool Sum = false;     // Changed by +=, -=, ++ or --
+  bool Product = false; // Changed by *=
+};
+
+// Finds the variables a loop body only accumulates into
+class Uses : public ASTVisitor {
+  llvm::DenseMap<unsigned, Use> &Found;
+  bool InExpr; // Whether the node is part of an expression or a loop header, not a statement
+
+  void add(AST *Node) {
+    if (!Node)
+      return;
+    bool Outer = InExpr;
+    InExpr = true;
+    Node->accept(*this);
+    InExpr = Outer;
+  }
+
+  void addBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    bool Outer = InExpr;
+    InExpr = false;
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+    InExpr = Outer;
+  }
+
+public:
+  Uses(llvm::DenseMap<unsigned, Use> &Found) : Found(Found), InExpr(false) {}
+
+  virtual void visit(Program &Node) override {
+    addBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &Node) override {
+    if (Node.getKind() == Final::Ident)
+      Found[key(Node.getRef())].Other = true;
+  };
+
+  virtual void visit(SignedNumber &) override {};
+
+  // Only a statement `x++;` accumulates; as an operand, `t = s++` also reads
+  // the value the iterations before left
+  virtual void visit(UnaryOp &Node) override {
+    Use &U = Found[key(Node.getRef())];
+    if (InExpr)
+      U.Other = true;
+    else
+      U.Sum = true;
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    add(Node.getExpr());
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    add(Node.getLeft());
+    add(Node.getRight());
+  };
+
+  virtual void visit(Comparison &Node) override {
+    add(Node.getLeft());
+    add(Node.getRight());
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    add(Node.getLeft());
+    add(Node.getRight());
+  };
+
+  virtual void visit(Assignment &Node) override {
+    add(Node.getRightExpr());
+    add(Node.getRightLogic());
+    Use &U = Found[key(Node.getLeft()->getRef())];
+    if (Node.getAssignKind() == Assignment::Plus_assign || Node.getAssignKind() == Assignment::Minus_assign)
+      U.Sum = true;
+    else if (Node.getAssignKind() == Assignment::Star_assign)
+      U.Product = true;
+    else
+      U.Other = true;
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    for (llvm::SmallVector<Expr *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      add(*I);
+    for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I)
+      Found[key(Node.getRef(I))].Other = true;
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    for (llvm::SmallVector<Logic *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      add(*I);
+    for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I)
+      Found[key(Node.getRef(I))].Other = true;
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+    Found[key(Node.getRef())].Other = true;
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    add(Node.getCond());
+    addBody(Node.begin(), Node.end());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    addBody(Node.beginElse(), Node.endElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    add(Node.getCond());
+    addBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    add(Node.getCond());
+    addBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    add(Node.getFirst());
+    add(Node.getSecond());
+    add(Node.getThirdAssign());
+    add(Node.getThirdUnary());
+    addBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    add(Node.getCond());
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    addBody(Node.begin(), Node.end());
+  };
+};
+
+class Parallelizer : public ASTVisitor {
+  unsigned Marked;
+
+  void visitBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+  }
+
+  // Fills in how the iterations of L share its variables if they can run in
+  // any order
+  static bool share(ForStmt *L, LoopSharing &Sharing) {
+    CountedLoop Counted;
+    if (!matchCountedLoop(L, Counted))
+      return false;
+
+    // Loops whose range is known to be short stay serial
+    ValueRange Range = L->getBodyRange();
+    if (Range.isKnown() && ((int64_t)Range.getHi() - Range.getLo()) / std::abs((int64_t)Counted.Step) + 1 < MinTrips)
+      return false;
+
+    // The bound is evaluated once, and every iteration computes its value of
+    // the induction variable from its number, so the header must not change
+    // anything else
+    Effects Body, Bound, Header;
+    for (llvm::SmallVector<AST *>::const_iterator I = L->begin(), E = L->end(); I != E; ++I)
+      (*I)->accept(Body);
+    Counted.Bound->accept(Bound);
+    L->getFirst()->accept(Header);
+    if (L->getThirdAssign())
+      L->getThirdAssign()->accept(Header);
+    else
+      L->getThirdUnary()->accept(Header);
+    if (Body.Writes.count(Counted.IndVar) || !Bound.Writes.empty())
+      return false;
+    for (unsigned K : Header.Writes)
+      if (K != Counted.IndVar)
+        return false;
+    for (unsigned K : Bound.Reads)
+      if (Body.Writes.count(K))
+        return false;
+
+    // Buffered output is lost if a later iteration stops the program first
+    if (Body.Prints && Body.MayNotFinish)
+      return false;
+
+    llvm::DenseSet<unsigned> Killed;
+    findKilled(L->begin(), L->end(), Killed);
+    llvm::DenseMap<unsigned, Use> Found;
+    Uses U(Found);
+    for (llvm::SmallVector<AST *>::const_iterator I = L->begin(), E = L->end(); I != E; ++I)
+      (*I)->accept(U);
+
+    Sharing = LoopSharing();
+    for (const auto &KV : Found) {
+      unsigned K = KV.first;
+      if (K == Counted.IndVar)
+        continue;
+      if (!Body.Writes.count(K))
+        Sharing.Shared.push_back(refOf(K));
+      else if (Killed.count(K))
+        Sharing.Private.push_back(refOf(K));
+      else if (!KV.second.Other && KV.second.Sum && !KV.second.Product)
+        Sharing.Sums.push_back(refOf(K));
+      else if (!KV.second.Other && KV.second.Product && !KV.second.Sum)
+        Sharing.Products.push_back(refOf(K));
+      else
+        return false;
+    }
+    Sharing.Parallel = true;
+    Sharing.Step = Counted.Step;
+    Sharing.Op = Counted.Op;
+    Sharing.Bound = Counted.Bound;
+    Sharing.MinTrips = MinTrips;
+    return true;
+  }
+
+public:
+  Parallelizer() : Marked(0) {}
+
+  unsigned getMarked() { return Marked; }
+
+  virtual void visit(Program &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    visitBody(Node.beginElse(), Node.endElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  // A loop inside a parallel loop already runs on one of its threads
+  virtual void visit(ForStmt &Node) override {
+    LoopSharing Sharing;
+    if (share(&Node, Sharing)) {
+      Node.getSharing() = Sharing;
+      ++Marked;
+      return;
+    }
+    Node.getSharing() = LoopSharing();
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  // Only statement lists hold loops
+  virtual void visit(Final &) override {};
+  virtual void visit(SignedNumber &) override {};
+  virtual void visit(UnaryOp &) override {};
+  virtual void visit(NegExpr &) override {};
+  virtual void visit(BinaryOp &) override {};
+  virtual void visit(Comparison &) override {};
+  virtual void visit(LogicalExpr &) override {};
+  virtual void visit(Assignment &) override {};
+  virtual void visit(DeclarationInt &) override {};
+  virtual void visit(DeclarationBool &) override {};
+  virtual void visit(PrintStmt &) override {};
+};
+}
+
+unsigned ParallelLoops::parallelize(Program *Tree) {
+  npar::Parallelizer P;
+  Tree->accept(P);
+  return P.getMarked();
+}
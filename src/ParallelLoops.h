@@ -0,0 +1,24 @@
+#ifndef PARALLELLOOPS_H
+#define PARALLELLOOPS_H
+
+#include "AST.h"
+#include "PassManager.h"
+
+class ParallelLoops : public ASTPass
+{
+public:
+  // Marks the outermost for loops whose iterations can run in any order: a
+  // loop counts towards a bound its body does not change, and each variable
+  // of the body is either only read, assigned before it is read in every
+  // iteration, or a sum or a product the iterations only add to. Printing
+  // bodies must not be able to stop the program. Returns the number of loops
+  // marked.
+  unsigned parallelize(Program *Tree);
+
+  bool run(Program *Tree) override
+  {
+    parallelize(Tree);
+    return false;
+  }
+};
+#endif
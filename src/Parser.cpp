@@ -121,6 +121,16 @@ Program *Parser::parseProgram()
             }
             break;
         }
+        case Token::KW_switch: {
+            SwitchStmt *sw;
+            sw = parseSwitch();
+            if (sw)
+                data.push_back(sw);
+            else {
+                goto _error;
+            }
+            break;
+        }
         case Token::KW_print: {
             PrintStmt *p;
             p = parsePrint();
@@ -149,8 +159,7 @@ Program *Parser::parseProgram()
     }
     return new Program(data);
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -221,8 +230,7 @@ DeclarationInt *Parser::parseIntDec()
 
     return new DeclarationInt(Vars, Values);
 _error: 
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -292,8 +300,7 @@ DeclarationBool *Parser::parseBoolDec()
     }
     return new DeclarationBool(Vars, Values);
 _error: 
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -334,8 +341,7 @@ Assignment *Parser::parseBoolAssign()
     }
     
 _error:
-        while (Tok.getKind() != Token::eoi)
-            advance();
+        skipToEnd();
         return nullptr;
     
 }
@@ -385,8 +391,7 @@ Assignment *Parser::parseIntAssign()
     }
 
 _error:
-        while (Tok.getKind() != Token::eoi)
-            advance();
+        skipToEnd();
         return nullptr;
 }
 
@@ -417,8 +422,7 @@ UnaryOp *Parser::parseUnary()
     return Res;
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 Expr *Parser::parseExpr()
@@ -453,8 +457,7 @@ Expr *Parser::parseExpr()
     return Left;
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -490,8 +493,7 @@ Expr *Parser::parseTerm()
     return Left;
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -522,8 +524,7 @@ Expr *Parser::parseFactor()
     return Left;
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -609,8 +610,7 @@ Expr *Parser::parseFinal()
     return Res;
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -689,8 +689,7 @@ Logic *Parser::parseComparison()
     return Res;
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -725,8 +724,7 @@ Logic *Parser::parseLogic()
     return Left;
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -866,8 +864,7 @@ IfStmt *Parser::parseIf()
     return new IfStmt(Cond, ifStmts, elseStmts, elifStmts);
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -899,8 +896,7 @@ PrintStmt *Parser::parsePrint()
     return new PrintStmt(Var);
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 
 }
@@ -947,8 +943,7 @@ WhileStmt *Parser::parseWhile()
     return new WhileStmt(Cond, Body);
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;
 }
 
@@ -1040,8 +1035,7 @@ ForStmt *Parser::parseFor()
     return new ForStmt(First, Second, ThirdAssign, ThirdUnary, Body);
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return nullptr;  
 
 }
@@ -1057,154 +1051,167 @@ void Parser::parseComment()
 
     return;
 _error: 
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
 }
 //====================================================================================================================
-SwitchStmt *Parser::parseSwitch() {
-    if (!Tok.is(Token::KW_switch)) {
-        error();
-        return nullptr;
+SwitchStmt *Parser::parseSwitch()
+{
+    llvm::SmallVector<CaseStmt *> Cases;
+    Expr *Cond = nullptr;
+    CaseStmt *Arm = nullptr;
+    bool hasDefault = false;
+
+    if (expect(Token::KW_switch)){
+        goto _error;
     }
-    advance(); // Consume 'switch'
 
-    if (!Tok.is(Token::l_paren)) {
-        error();
-        return nullptr;
+    advance();
+
+    if (expect(Token::l_paren)){
+        goto _error;
     }
-    advance(); // Consume '('
 
-    // Parse the switch condition
-    Expr *condition = parseExpr();
-    if (!condition) {
-        error();
-        return nullptr;
+    advance();
+
+    Cond = parseExpr();
+    if (Cond == nullptr)
+    {
+        goto _error;
     }
 
-    if (!Tok.is(Token::r_paren)) {
-        error();
-        return nullptr;
+    if (expect(Token::r_paren)){
+        goto _error;
     }
-    advance(); // Consume ')'
 
-    if (!Tok.is(Token::l_brace)) {
-        error();
-        return nullptr;
+    advance();
+
+    if (expect(Token::l_brace)){
+        goto _error;
     }
-    advance(); // Consume '{'
 
-    // Parse cases and default
-    llvm::SmallVector<CaseStmt *> cases;
-    DefaultStmt *defaultCase = nullptr;
+    advance();
 
-    while (!Tok.is(Token::r_brace)) {
-        if (Tok.is(Token::KW_case)) {
-            CaseStmt *caseStmt = parseCase();
-            if (!caseStmt) {
-                error();
-                return nullptr;
-            }
-            cases.push_back(caseStmt);
-        } else if (Tok.is(Token::KW_default)) {
-            if (defaultCase != nullptr) {
-                error(); // Only one default case allowed
-                return nullptr;
-            }
-            defaultCase = parseDefault();
-            if (!defaultCase) {
+    // Each arm leaves the look-ahead on the 'case', 'default' or '}' after it
+    while (!Tok.is(Token::r_brace))
+    {
+        if (Tok.is(Token::KW_default))
+        {
+            // Only one default arm is allowed
+            if (hasDefault)
+            {
                 error();
-                return nullptr;
+                goto _error;
             }
-        } else {
-            error(); // Unexpected token inside switch
-            return nullptr;
+            hasDefault = true;
+            Arm = parseDefault();
         }
+        else
+            Arm = parseCase();
+
+        if (Arm == nullptr)
+            goto _error;
+        Cases.push_back(Arm);
     }
-    advance(); // Consume '}'
 
-    // Return the switch statement node
-    return new SwitchStmt(condition, cases, defaultCase);
+    if (Cases.empty())
+        goto _error;
+
+    return new SwitchStmt(Cond, Cases);
+
+_error:
+    skipToEnd();
+    return nullptr;
 }
 
+CaseStmt *Parser::parseCase()
+{
+    llvm::SmallVector<AST *> Body;
+    Expr *Value = nullptr;
 
-CaseStmt *Parser::parseCase() {
-    // Ensure we start with 'case'
-    if (!Tok.is(Token::KW_case)) {
-        error();
-        return nullptr;
+    if (expect(Token::KW_case)){
+        goto _error;
     }
-    advance(); // Consume 'case'
 
-    // Parse the case value (e.g., an integer, character, or expression)
-    Expr *caseValue = parseExpr();
-    if (!caseValue) {
-        error();
-        return nullptr;
-    }
+    advance();
 
-    // Ensure there is a colon following the case value
-    if (!Tok.is(Token::colon)) {
-        error();
-        return nullptr;
+    Value = parseExpr();
+    if (Value == nullptr)
+    {
+        goto _error;
     }
-    advance(); // Consume ':'
 
-    // Parse the body of the case
-    llvm::SmallVector<AST *> body;
-    while (!Tok.is(Token::KW_case) && !Tok.is(Token::KW_default) && !Tok.is(Token::r_brace)) {
-        AST *stmt = parseProgram();//=====================================================================have to make a change
-        if (!stmt) {
-            error();
-            return nullptr;
-        }
-        body.push_back(stmt);
+    if (expect(Token::colon)){
+        goto _error;
     }
 
-    // Return the case statement node
-    return new CaseStmt(caseValue, body);
+    advance();
+
+    // An arm may be empty, so that several labels share the statements of the
+    // arm after them
+    Body = getBody(true);
+
+    return new CaseStmt(Value, Body);
+
+_error:
+    skipToEnd();
+    return nullptr;
 }
 
+DefaultStmt *Parser::parseDefault()
+{
+    llvm::SmallVector<AST *> Body;
 
-DefaultStmt *Parser::parseDefault() {
-    // Ensure we start with 'default'
-    if (!Tok.is(Token::KW_default)) {
-        error();
-        return nullptr;
+    if (expect(Token::KW_default)){
+        goto _error;
     }
-    advance(); // Consume 'default'
 
-    // Ensure there is a colon following 'default'
-    if (!Tok.is(Token::colon)) {
-        error();
-        return nullptr;
-    }
-    advance(); // Consume ':'
+    advance();
 
-    // Parse the body of the default case
-    llvm::SmallVector<AST *> body;
-    while (!Tok.is(Token::KW_case) && !Tok.is(Token::r_brace)) {
-        AST *stmt = parseProgram();
-        if (!stmt) {
-            error();
-            return nullptr;
-        }
-        body.push_back(stmt);
+    if (expect(Token::colon)){
+        goto _error;
     }
 
-    // Return the default case node
-    return new DefaultStmt(body);
-}
+    advance();
 
+    Body = getBody(true);
 
+    return new DefaultStmt(Body);
+
+_error:
+    skipToEnd();
+    return nullptr;
+}
+
+// Parses statements up to the closing '}' of a block, or up to the next label
+// as well if InCase is set
+llvm::SmallVector<AST *> Parser::getBody(bool InCase)
 
-llvm::SmallVector<AST *> Parser::getBody()
 {
     llvm::SmallVector<AST *> body;
-    while (!Tok.is(Token::r_brace))
+    while (!Tok.is(Token::r_brace) && !(InCase && Tok.isOneOf(Token::KW_case, Token::KW_default)))
     {
         switch (Tok.getKind())
         {
-        
+        case Token::KW_int: {
+            DeclarationInt *d;
+            d = parseIntDec();
+            if (d)
+                body.push_back(d);
+            else
+                goto _error;
+
+            break;
+        }
+        case Token::KW_bool: {
+            DeclarationBool *dbool;
+            dbool = parseBoolDec();
+            if (dbool)
+                body.push_back(dbool);
+            else
+                goto _error;
+
+            break;
+        }
         case Token::ident:{
             Token prev_token = Tok;
             const char* prev_buffer = Lex.getBuffer();
@@ -1294,6 +1301,16 @@ llvm::SmallVector<AST *> Parser::getBody()
             }
             break;
         }
+        case Token::KW_switch: {
+            SwitchStmt *sw;
+            sw = parseSwitch();
+            if (sw)
+                body.push_back(sw);
+            else {
+                goto _error;
+            }
+            break;
+        }
         case Token::KW_print: {
             PrintStmt *p;
             p = parsePrint();
@@ -1320,13 +1337,12 @@ llvm::SmallVector<AST *> Parser::getBody()
         advance();
 
     }
-    if(Tok.is(Token::r_brace)){
+    if(Tok.isOneOf(Token::r_brace, Token::KW_case, Token::KW_default)){
         return body;
     }
 
 _error:
-    while (Tok.getKind() != Token::eoi)
-        advance();
+    skipToEnd();
     return body;
 
 }
@@ -31,6 +31,10 @@ class Parser
         return false;
     }
 
+    // gives up on the rest of the input after an error; the speculative parses
+    // reset the lexer afterwards, so this must not lex the rest token by token
+    void skipToEnd() { Lex.skipToEnd(Tok); }
+
     // retrieves the next token if the look-ahead is of the expected kind
     bool consume(Token::TokenKind Kind)
     {
@@ -63,7 +67,7 @@ class Parser
     void parseComment();
     
 
-    llvm::SmallVector<AST *> getBody();
+    llvm::SmallVector<AST *> getBody(bool InCase = false);
 
 public:
     // initializes all members and retrieves the first token
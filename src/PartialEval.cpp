@@ -0,0 +1,274 @@
+#include "PartialEval.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace npe{
+class Evaluator : public ASTVisitor {
+  llvm::SmallVector<int32_t> IntVars;  // Values of int variables, indexed by Sema's slot
+  llvm::SmallVector<int32_t> BoolVars; // Values of bool variables, 0 or 1
+  llvm::raw_ostream &Out;
+  uint64_t Steps; // Steps left
+  bool Stopped;   // Whether evaluation gave up
+  int32_t Val;    // Value of the expression visited last
+
+  static int32_t wrap(uint32_t V) { return (int32_t)V; }
+
+  int32_t &var(VarRef R) {
+    llvm::SmallVector<int32_t> &Vars = R.isBool() ? BoolVars : IntVars;
+    if (Vars.size() <= R.getSlot())
+      Vars.resize(R.getSlot() + 1, 0);
+    return Vars[R.getSlot()];
+  }
+
+  bool step() {
+    if (Steps == 0)
+      Stopped = true;
+    else
+      --Steps;
+    return !Stopped;
+  }
+
+  int32_t eval(AST *Node) {
+    Node->accept(*this);
+    return Val;
+  }
+
+  // sdiv and srem trap on these, so the program has to run for real
+  bool divides(int32_t L, int32_t R) {
+    if (R == 0 || (L == INT32_MIN && R == -1))
+      Stopped = true;
+    return !Stopped;
+  }
+
+  void run(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E && step(); ++I)
+      (*I)->accept(*this);
+  }
+
+public:
+  Evaluator(llvm::raw_ostream &Out, uint64_t Budget) : Out(Out), Steps(Budget), Stopped(false), Val(0) {}
+
+  bool finished() { return !Stopped; }
+
+  virtual void visit(Program &Node) override {
+    run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &Node) override {
+    if (Node.getKind() == Final::Ident)
+      Val = var(Node.getRef());
+    else if (Node.getVal().getAsInteger(10, Val))
+      Stopped = true;
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    if (Node.getValue().getAsInteger(10, Val))
+      Stopped = true;
+    else if (Node.getSign() == SignedNumber::Minus)
+      Val = wrap(0u - (uint32_t)Val);
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    // Like the generated code, the expression has the updated value
+    int32_t &V = var(Node.getRef());
+    V = wrap((uint32_t)V + (Node.getOperator() == UnaryOp::Plus_plus ? 1u : -1u));
+    Val = V;
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    Val = wrap(0u - (uint32_t)eval(Node.getExpr()));
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    int32_t L = eval(Node.getLeft());
+    int32_t R = eval(Node.getRight());
+    switch (Node.getOperator())
+    {
+    case BinaryOp::Plus:
+      Val = wrap((uint32_t)L + (uint32_t)R);
+      break;
+    case BinaryOp::Minus:
+      Val = wrap((uint32_t)L - (uint32_t)R);
+      break;
+    case BinaryOp::Mul:
+      Val = wrap((uint32_t)L * (uint32_t)R);
+      break;
+    case BinaryOp::Div:
+      Val = divides(L, R) ? L / R : 0;
+      break;
+    case BinaryOp::Mod:
+      Val = divides(L, R) ? L % R : 0;
+      break;
+    case BinaryOp::Exp: {
+      // Matches CreateExp: L multiplied R times, 1 for R <= 0
+      uint32_t Base = L, Res = 1;
+      for (uint32_t E = R > 0 ? R : 0; E; E >>= 1) {
+        if (E & 1)
+          Res *= Base;
+        Base *= Base;
+      }
+      Val = wrap(Res);
+      break;
+    }
+    default:
+      Stopped = true;
+      break;
+    }
+  };
+
+  virtual void visit(Comparison &Node) override {
+    switch (Node.getOperator())
+    {
+    case Comparison::True:
+      Val = 1;
+      return;
+    case Comparison::False:
+      Val = 0;
+      return;
+    case Comparison::Ident:
+      Val = var(((Final *)Node.getLeft())->getRef());
+      return;
+    default:
+      break;
+    }
+    int32_t L = eval(Node.getLeft());
+    int32_t R = eval(Node.getRight());
+    switch (Node.getOperator())
+    {
+    case Comparison::Equal:
+      Val = L == R;
+      break;
+    case Comparison::Not_equal:
+      Val = L != R;
+      break;
+    case Comparison::Greater:
+      Val = L > R;
+      break;
+    case Comparison::Less:
+      Val = L < R;
+      break;
+    case Comparison::Greater_equal:
+      Val = L >= R;
+      break;
+    case Comparison::Less_equal:
+      Val = L <= R;
+      break;
+    default:
+      Stopped = true;
+      break;
+    }
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    // The right operand is only evaluated if the left one does not decide
+    int32_t L = eval(Node.getLeft());
+    if (!Node.getRight())
+      return;
+    if (Node.getOperator() == LogicalExpr::And ? !L : L) {
+      Val = L != 0;
+      return;
+    }
+    Val = eval(Node.getRight()) != 0;
+  };
+
+  virtual void visit(Assignment &Node) override {
+    int32_t R = Node.getRightExpr() ? eval(Node.getRightExpr()) : eval(Node.getRightLogic());
+    int32_t &V = var(Node.getLeft()->getRef());
+    switch (Node.getAssignKind())
+    {
+    case Assignment::Assign:
+      V = R;
+      break;
+    case Assignment::Plus_assign:
+      V = wrap((uint32_t)V + (uint32_t)R);
+      break;
+    case Assignment::Minus_assign:
+      V = wrap((uint32_t)V - (uint32_t)R);
+      break;
+    case Assignment::Star_assign:
+      V = wrap((uint32_t)V * (uint32_t)R);
+      break;
+    case Assignment::Slash_assign:
+      if (divides(V, R))
+        V = V / R;
+      break;
+    }
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    // All initializers are evaluated before any of the variables is stored
+    llvm::SmallVector<int32_t, 8> Vals;
+    for (llvm::SmallVector<Expr *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      Vals.push_back(*I ? eval(*I) : 0);
+    for (unsigned I = 0, E = Vals.size(); I != E; ++I)
+      var(Node.getRef(I)) = Vals[I];
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    llvm::SmallVector<int32_t, 8> Vals;
+    for (llvm::SmallVector<Logic *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      Vals.push_back(*I ? eval(*I) : 0);
+    for (unsigned I = 0, E = Vals.size(); I != E; ++I)
+      var(Node.getRef(I)) = Vals[I];
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+    int32_t V = var(Node.getRef());
+    if (Node.getRef().isBool())
+      Out << (V ? "true" : "false") << "\n";
+    else
+      Out << V << "\n";
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    if (eval(Node.getCond())) {
+      run(Node.begin(), Node.end());
+      return;
+    }
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      if (step() && eval((*I)->getCond())) {
+        (*I)->accept(*this);
+        return;
+      }
+    run(Node.beginElse(), Node.endElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    // Control enters at the matching arm and falls through the ones after it
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.findArm(eval(Node.getCond())), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    while (step() && eval(Node.getCond()))
+      run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    Node.getFirst()->accept(*this);
+    while (step() && eval(Node.getSecond())) {
+      run(Node.begin(), Node.end());
+      if (Node.getThirdAssign())
+        Node.getThirdAssign()->accept(*this);
+      else
+        Node.getThirdUnary()->accept(*this);
+    }
+  };
+};
+}
+
+bool PartialEval::evaluate(Program *Tree, uint64_t Budget) {
+  Output.clear();
+  llvm::raw_string_ostream OS(Output);
+  npe::Evaluator E(OS, Budget);
+  Tree->accept(E);
+  OS.flush();
+  return E.finished();
+}
@@ -0,0 +1,21 @@
+#ifndef PARTIALEVAL_H
+#define PARTIALEVAL_H
+
+#include "AST.h"
+#include <cstdint>
+#include <string>
+
+class PartialEval
+{
+  std::string Output; // What the program printed, formatted as the runtime does
+
+public:
+  // Runs the program at compile time with the integer semantics of the
+  // generated code. Every executed statement and loop test is a step. Returns
+  // true if the program finished within Budget steps; false if it ran out, or
+  // reached a division that traps at run time, so it must be compiled instead.
+  bool evaluate(Program *Tree, uint64_t Budget);
+
+  llvm::StringRef getOutput() { return Output; }
+};
+#endif
@@ -0,0 +1,213 @@
+#include "PassManager.h"
+#include "ConstFold.h"
+#include "DeadCode.h"
+#include "DeadInit.h"
+#include "LoopFusion.h"
+#include "ParallelLoops.h"
+#include "RangeAnalysis.h"
+#include "llvm/Support/Format.h"
+#include <chrono>
+
+namespace npm{
+// Counts the nodes of a tree
+class NodeCounter : public ASTVisitor {
+  unsigned Count;
+
+  void count(AST *Node) {
+    if (Node)
+      Node->accept(*this);
+  }
+
+  void countBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+  }
+
+public:
+  NodeCounter() : Count(0) {}
+
+  unsigned getCount() { return Count; }
+
+  virtual void visit(Program &Node) override {
+    ++Count;
+    countBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &Node) override {
+    ++Count;
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    ++Count;
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    ++Count;
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    ++Count;
+    count(Node.getExpr());
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    ++Count;
+    count(Node.getLeft());
+    count(Node.getRight());
+  };
+
+  virtual void visit(Comparison &Node) override {
+    ++Count;
+    count(Node.getLeft());
+    count(Node.getRight());
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    ++Count;
+    count(Node.getLeft());
+    count(Node.getRight());
+  };
+
+  virtual void visit(Assignment &Node) override {
+    ++Count;
+    count(Node.getLeft());
+    count(Node.getRightExpr());
+    count(Node.getRightLogic());
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    ++Count;
+    for (llvm::SmallVector<Expr *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      count(*I);
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    ++Count;
+    for (llvm::SmallVector<Logic *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      count(*I);
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+    ++Count;
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    ++Count;
+    count(Node.getCond());
+    countBody(Node.begin(), Node.end());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    countBody(Node.beginElse(), Node.endElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    ++Count;
+    count(Node.getCond());
+    countBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    ++Count;
+    count(Node.getCond());
+    countBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    ++Count;
+    count(Node.getFirst());
+    count(Node.getSecond());
+    count(Node.getThirdAssign());
+    count(Node.getThirdUnary());
+    countBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    ++Count;
+    count(Node.getCond());
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    ++Count;
+    count(Node.getValue());
+    countBody(Node.begin(), Node.end());
+  };
+};
+
+static unsigned countNodes(Program *Tree) {
+  NodeCounter C;
+  Tree->accept(C);
+  return C.getCount();
+}
+}
+
+ASTPassManager::ASTPassManager() {
+  registerPass("fold", "Replace constant subtrees by literals",
+               []() -> std::unique_ptr<ASTPass> { return std::make_unique<ConstFold>(); });
+  registerPass("dce", "Remove unreachable code and values that never reach a print",
+               []() -> std::unique_ptr<ASTPass> { return std::make_unique<DeadCode>(); });
+  registerPass("fuse", "Merge adjacent for loops with the same header and independent bodies",
+               []() -> std::unique_ptr<ASTPass> { return std::make_unique<LoopFusion>(); });
+  registerPass("dead-init", "Drop initializers overwritten before they are read",
+               []() -> std::unique_ptr<ASTPass> { return std::make_unique<DeadInit>(); });
+  registerPass("ranges", "Record value ranges for the code generator",
+               []() -> std::unique_ptr<ASTPass> { return std::make_unique<RangeAnalysis>(); });
+  registerPass("parallel", "Mark for loops whose iterations can run on several threads; run it last",
+               []() -> std::unique_ptr<ASTPass> { return std::make_unique<ParallelLoops>(); });
+}
+
+void ASTPassManager::registerPass(llvm::StringRef Name, llvm::StringRef Desc, PassFactory Create) {
+  Registry.push_back({Name, Desc, Create});
+}
+
+bool ASTPassManager::parsePipeline(llvm::StringRef Spec, llvm::raw_ostream &Diag) {
+  Pipeline.clear();
+  llvm::SmallVector<llvm::StringRef, 8> Names;
+  Spec.split(Names, ',', -1, false);
+  for (llvm::StringRef Name : Names) {
+    Name = Name.trim();
+    unsigned I = 0, E = Registry.size();
+    while (I != E && Registry[I].Name != Name)
+      ++I;
+    if (I == E) {
+      Diag << "Unknown AST pass '" << Name << "'. Available passes:\n";
+      for (const PassInfo &P : Registry)
+        Diag << "  " << P.Name << " - " << P.Desc << "\n";
+      return true;
+    }
+    Pipeline.push_back({I, Registry[I].Create(), 0, 0, 0});
+  }
+  return false;
+}
+
+bool ASTPassManager::run(Program *Tree, bool Measure) {
+  for (PipelineEntry &P : Pipeline) {
+    if (!Measure) {
+      if (P.Pass->run(Tree))
+        return true;
+      continue;
+    }
+    P.NodesBefore = npm::countNodes(Tree);
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+    bool Error = P.Pass->run(Tree);
+    P.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    P.NodesAfter = npm::countNodes(Tree);
+    if (Error)
+      return true;
+  }
+  return false;
+}
+
+void ASTPassManager::printSummary(llvm::raw_ostream &OS) {
+  double Total = 0;
+  OS << "===--- AST pass summary ---===\n";
+  OS << "  Time (ms)  Nodes before  Nodes after   Change  Pass\n";
+  for (PipelineEntry &P : Pipeline) {
+    Total += P.Seconds;
+    OS << llvm::format("  %9.3f  %12u  %11u  %+7d  ", P.Seconds * 1000, P.NodesBefore, P.NodesAfter,
+                       (int)P.NodesAfter - (int)P.NodesBefore)
+       << Registry[P.Info].Name << "\n";
+  }
+  OS << llvm::format("  %9.3f", Total * 1000) << "  Total\n";
+}
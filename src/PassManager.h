@@ -0,0 +1,69 @@
+#ifndef PASSMANAGER_H
+#define PASSMANAGER_H
+
+#include "AST.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+
+// ASTPass is the interface of the transformations that run on the checked
+// tree before code generation. A pass may rewrite the tree in place.
+class ASTPass
+{
+public:
+  virtual ~ASTPass() {}
+
+  // Runs the pass over the program. Returns true if it found errors.
+  virtual bool run(Program *Tree) = 0;
+};
+
+class ASTPassManager
+{
+public:
+  using PassFactory = std::unique_ptr<ASTPass> (*)();
+
+  // The passes run when no pipeline is given. Loop fusion and parallel loops
+  // are opt-in: add fuse after dce and parallel last.
+  static constexpr const char *DefaultPipeline = "fold,dce,dead-init,ranges";
+
+private:
+  struct PassInfo
+  {
+    llvm::StringRef Name;
+    llvm::StringRef Desc;
+    PassFactory Create;
+  };
+
+  // A pass of the pipeline and what was measured when it ran
+  struct PipelineEntry
+  {
+    unsigned Info; // Index in Registry
+    std::unique_ptr<ASTPass> Pass;
+    double Seconds;
+    unsigned NodesBefore;
+    unsigned NodesAfter;
+  };
+
+  llvm::SmallVector<PassInfo> Registry;
+  llvm::SmallVector<PipelineEntry> Pipeline;
+
+public:
+  // Registers the passes that come with the compiler.
+  ASTPassManager();
+
+  // Makes a pass available to pipelines under Name. The factory is called once
+  // for every occurrence of the name in the pipeline; the passes live as long
+  // as the manager, so they may own parts of the tree they create.
+  void registerPass(llvm::StringRef Name, llvm::StringRef Desc, PassFactory Create);
+
+  // Sets the pipeline from a comma-separated list of pass names. Returns true
+  // and reports to Diag if a name is not registered.
+  bool parsePipeline(llvm::StringRef Spec, llvm::raw_ostream &Diag);
+
+  // Runs the pipeline in order and stops at the first pass that finds errors.
+  // With Measure, the time and the tree size around every pass are recorded.
+  bool run(Program *Tree, bool Measure = false);
+
+  // Prints the measurements of the last run.
+  void printSummary(llvm::raw_ostream &OS);
+};
+#endif
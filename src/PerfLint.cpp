@@ -0,0 +1,569 @@
+#include "PerfLint.h"
+#include "LoopEffects.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+
+namespace nperf{
+// Estimated cycles of the code CodeGen emits: one per load, store, arithmetic
+// operation and comparison, more for a division, and for a '^' that needs a
+// loop a fixed part and a part per bit of the exponent.
+static const uint64_t DivCycles = 20;
+static const uint64_t ExpFixedCycles = 3;
+static const uint64_t ExpStepCycles = 9;
+
+// An operand of 'and'/'or' costing this much is worth skipping
+static const uint64_t CostlyOperand = 20;
+
+// Writes an expression, a condition or the header of a statement as it would
+// be written in the source
+class Printer : public ASTVisitor {
+  llvm::raw_ostream &OS;
+  bool InBinary;  // Whether the node is an operand of an arithmetic operation
+  bool InLogical; // Whether the node is an operand of 'and'/'or'
+
+  void print(AST *Node) {
+    if (Node)
+      Node->accept(*this);
+  }
+
+public:
+  Printer(llvm::raw_ostream &OS) : OS(OS), InBinary(false), InLogical(false) {}
+
+  virtual void visit(Final &Node) override {
+    OS << Node.getVal();
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    OS << (Node.getSign() == SignedNumber::Minus ? "-" : "") << Node.getValue();
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    OS << Node.getIdent() << (Node.getOperator() == UnaryOp::Plus_plus ? "++" : "--");
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    bool Saved = InBinary;
+    InBinary = false;
+    OS << "-(";
+    print(Node.getExpr());
+    OS << ")";
+    InBinary = Saved;
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    static const char *Ops[] = {" + ", " - ", " * ", " / ", " % ", " ^ ", " xor "};
+    bool Paren = InBinary;
+    InBinary = true;
+    if (Paren)
+      OS << "(";
+    print(Node.getLeft());
+    OS << Ops[Node.getOperator()];
+    print(Node.getRight());
+    if (Paren)
+      OS << ")";
+    InBinary = Paren;
+  };
+
+  virtual void visit(Comparison &Node) override {
+    static const char *Ops[] = {" == ", " != ", " > ", " < ", " >= ", " <= "};
+    switch (Node.getOperator()) {
+    case Comparison::True:
+      OS << "true";
+      return;
+    case Comparison::False:
+      OS << "false";
+      return;
+    case Comparison::Ident:
+      print(Node.getLeft());
+      return;
+    default:
+      break;
+    }
+    bool Saved = InBinary;
+    InBinary = false;
+    print(Node.getLeft());
+    OS << Ops[Node.getOperator()];
+    print(Node.getRight());
+    InBinary = Saved;
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    if (Node.getRight() == nullptr) {
+      print(Node.getLeft());
+      return;
+    }
+    bool Paren = InLogical;
+    InLogical = true;
+    if (Paren)
+      OS << "(";
+    print(Node.getLeft());
+    OS << (Node.getOperator() == LogicalExpr::And ? " and " : " or ");
+    print(Node.getRight());
+    if (Paren)
+      OS << ")";
+    InLogical = Paren;
+  };
+
+  virtual void visit(Assignment &Node) override {
+    static const char *Ops[] = {" = ", " -= ", " += ", " *= ", " /= "};
+    print(Node.getLeft());
+    OS << Ops[Node.getAssignKind()];
+    print(Node.getRightExpr());
+    print(Node.getRightLogic());
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    OS << "int ";
+    llvm::SmallVector<Expr *>::const_iterator Val = Node.valBegin();
+    for (llvm::SmallVector<llvm::StringRef>::const_iterator I = Node.varBegin(), E = Node.varEnd(); I != E; ++I, ++Val) {
+      OS << (I == Node.varBegin() ? "" : ", ") << *I;
+      if (Val < Node.valEnd() && *Val) {
+        OS << " = ";
+        print(*Val);
+      }
+    }
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    OS << "bool ";
+    llvm::SmallVector<Logic *>::const_iterator Val = Node.valBegin();
+    for (llvm::SmallVector<llvm::StringRef>::const_iterator I = Node.varBegin(), E = Node.varEnd(); I != E; ++I, ++Val) {
+      OS << (I == Node.varBegin() ? "" : ", ") << *I;
+      if (Val < Node.valEnd() && *Val) {
+        OS << " = ";
+        print(*Val);
+      }
+    }
+  };
+
+  // Statements are printed by their header only
+  virtual void visit(WhileStmt &Node) override {
+    OS << "while (";
+    print(Node.getCond());
+    OS << ")";
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    OS << "for (";
+    print(Node.getFirst());
+    OS << "; ";
+    print(Node.getSecond());
+    OS << "; ";
+    print(Node.getThirdAssign());
+    print(Node.getThirdUnary());
+    OS << ")";
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+    OS << "print(" << Node.getVar() << ")";
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    OS << "if (";
+    print(Node.getCond());
+    OS << ")";
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    OS << "else if (";
+    print(Node.getCond());
+    OS << ")";
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    OS << "switch (";
+    print(Node.getCond());
+    OS << ")";
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    OS << "case ";
+    print(Node.getValue());
+    OS << ":";
+  };
+
+  virtual void visit(DefaultStmt &) override {
+    OS << "default:";
+  };
+};
+
+static std::string toString(AST *Node) {
+  std::string S;
+  llvm::raw_string_ostream OS(S);
+  Printer P(OS);
+  Node->accept(P);
+  return OS.str();
+}
+
+// Estimates the cycles one evaluation of an expression or a condition takes
+// and records the variables it reads. A '^' with a literal exponent or a base
+// of 0, 1, -1 or a power of two needs no loop. Otherwise the loop of '^' runs
+// once per bit of its exponent, which has at most 31 if the exponent is not a
+// variable with a range.
+class Cost : public ASTVisitor {
+  uint64_t Cycles;
+  bool HasMax;
+  int64_t Max;  // Largest value of the expression visited last, if HasMax
+  bool Literal; // Whether the expression visited last is a literal, Max
+  bool ExpLoop; // Whether the '^' visited last runs a loop
+  bool Effects; // Whether a ++ or -- was visited
+  llvm::SmallVector<unsigned> Reads;
+
+  void cost(AST *Node) {
+    Literal = false;
+    if (Node)
+      Node->accept(*this);
+  }
+
+  void literal(llvm::StringRef Text, bool Negative) {
+    int64_t Val;
+    HasMax = Literal = !Text.getAsInteger(10, Val);
+    Max = Negative ? -Val : Val;
+  }
+
+public:
+  Cost() : Cycles(0), HasMax(false), Max(0), Literal(false), ExpLoop(false), Effects(false) {}
+
+  uint64_t getCycles() { return Cycles; }
+
+  bool hasExpLoop() { return ExpLoop; }
+
+  bool hasEffects() { return Effects; }
+
+  const llvm::SmallVector<unsigned> &getReads() { return Reads; }
+
+  virtual void visit(Final &Node) override {
+    if (Node.getKind() == Final::Number) {
+      literal(Node.getVal(), false);
+      return;
+    }
+    ++Cycles;
+    Reads.push_back(nloop::key(Node.getRef()));
+    HasMax = Node.getRange().isKnown();
+    Max = Node.getRange().getHi();
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    literal(Node.getValue(), Node.getSign() == SignedNumber::Minus);
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    Cycles += 3;
+    Reads.push_back(nloop::key(Node.getRef()));
+    HasMax = false;
+    Effects = true;
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    cost(Node.getExpr());
+    ++Cycles;
+    HasMax = false;
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    cost(Node.getLeft());
+    bool LiteralBase = Literal;
+    int64_t Base = Max;
+    cost(Node.getRight());
+    switch (Node.getOperator()) {
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+      Cycles += DivCycles;
+      break;
+    case BinaryOp::Exp:
+      ExpLoop = false;
+      if (Literal) {
+        // A chain of at most one squaring per bit and one multiplication per
+        // set bit after the first
+        if (Max > 0)
+          Cycles += llvm::Log2_64(Max) + llvm::countPopulation((uint64_t)Max) - 1;
+      } else if (LiteralBase && (Base == 0 || Base == 1 || Base == -1 || (Base > 0 && llvm::isPowerOf2_64(Base)))) {
+        Cycles += 4;
+      } else {
+        ExpLoop = true;
+        Cycles += ExpFixedCycles + ExpStepCycles * (HasMax ? (Max > 0 ? llvm::Log2_64(Max) + 1 : 0) : 31);
+      }
+      break;
+    default:
+      ++Cycles;
+      break;
+    }
+    HasMax = false;
+  };
+
+  virtual void visit(Comparison &Node) override {
+    cost(Node.getLeft());
+    cost(Node.getRight());
+    if (Node.getRight())
+      ++Cycles;
+    HasMax = false;
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    cost(Node.getLeft());
+    cost(Node.getRight());
+    if (Node.getRight())
+      ++Cycles;
+    HasMax = false;
+  };
+
+  // Only expressions and conditions are costed
+  virtual void visit(Assignment &) override {};
+  virtual void visit(DeclarationInt &) override {};
+  virtual void visit(DeclarationBool &) override {};
+  virtual void visit(IfStmt &) override {};
+  virtual void visit(elifStmt &) override {};
+  virtual void visit(WhileStmt &) override {};
+  virtual void visit(ForStmt &) override {};
+  virtual void visit(PrintStmt &) override {};
+  virtual void visit(SwitchStmt &) override {};
+  virtual void visit(CaseStmt &) override {};
+};
+
+// Writes the estimate of C, to which Extra cycles are added
+static void describe(llvm::raw_ostream &OS, Cost &C, uint64_t Extra = 0) {
+  uint64_t Cycles = C.getCycles() + Extra;
+  OS << "estimated cost " << Cycles << (Cycles == 1 ? " cycle" : " cycles");
+}
+
+// Collects the variables a statement list assigns or declares
+class Writes : public ASTVisitor {
+  llvm::DenseSet<unsigned> &Keys;
+
+  void visitBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+  }
+
+public:
+  Writes(llvm::DenseSet<unsigned> &Keys) : Keys(Keys) {}
+
+  virtual void visit(Assignment &Node) override {
+    Keys.insert(nloop::key(Node.getLeft()->getRef()));
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    Keys.insert(nloop::key(Node.getRef()));
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I)
+      Keys.insert(nloop::key(Node.getRef(I)));
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    for (unsigned I = 0, E = Node.varEnd() - Node.varBegin(); I != E; ++I)
+      Keys.insert(nloop::key(Node.getRef(I)));
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    visitBody(Node.beginElse(), Node.endElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    Node.getFirst()->accept(*this);
+    if (Node.getThirdAssign())
+      Node.getThirdAssign()->accept(*this);
+    if (Node.getThirdUnary())
+      Node.getThirdUnary()->accept(*this);
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  // Expressions do not write variables
+  virtual void visit(Final &) override {};
+  virtual void visit(SignedNumber &) override {};
+  virtual void visit(NegExpr &) override {};
+  virtual void visit(BinaryOp &) override {};
+  virtual void visit(Comparison &) override {};
+  virtual void visit(LogicalExpr &) override {};
+  virtual void visit(PrintStmt &) override {};
+};
+
+class Linter : public ASTVisitor {
+  llvm::raw_ostream &OS;
+  unsigned Warnings;
+  std::string Loop; // Header of the innermost loop around the current point, empty outside of loops
+  llvm::DenseSet<unsigned> LoopWrites; // Variables that loop assigns or declares
+
+  void check(AST *Node) {
+    if (Node)
+      Node->accept(*this);
+  }
+
+  void visitBody(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+  }
+
+  // Checks a loop: its header is Node, everything but Once runs on every iteration
+  template <typename LoopStmt> void loop(LoopStmt &Node, AST *Once, llvm::ArrayRef<AST *> Header) {
+    check(Once);
+    std::string SavedLoop = toString(&Node);
+    llvm::DenseSet<unsigned> SavedWrites;
+    std::swap(Loop, SavedLoop);
+    std::swap(LoopWrites, SavedWrites);
+    Writes W(LoopWrites);
+    Node.accept(W);
+    for (AST *H : Header)
+      check(H);
+    visitBody(Node.begin(), Node.end());
+    std::swap(Loop, SavedLoop);
+    std::swap(LoopWrites, SavedWrites);
+  }
+
+  template <typename Decl> void declaration(Decl &Node) {
+    if (!Loop.empty()) {
+      Cost C;
+      unsigned Initialized = 0;
+      for (auto I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+        if (*I) {
+          (*I)->accept(C);
+          ++Initialized;
+        }
+      if (Initialized) {
+        bool Invariant = true;
+        for (unsigned R : C.getReads())
+          Invariant &= !LoopWrites.count(R);
+        OS << "warning: '" << toString(&Node) << "' in the body of '" << Loop << "' initializes "
+           << Initialized << (Initialized == 1 ? " variable" : " variables") << " on every iteration; ";
+        // Every initial value is also stored
+        describe(OS, C, Initialized);
+        OS << " per iteration";
+        if (Invariant && C.getCycles())
+          OS << "; the initial values do not depend on the loop and can be computed before it";
+        OS << " [-Wperf]\n";
+        ++Warnings;
+      }
+    }
+    for (auto I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      check(*I);
+  }
+
+public:
+  Linter(llvm::raw_ostream &OS) : OS(OS), Warnings(0) {}
+
+  unsigned getWarnings() { return Warnings; }
+
+  virtual void visit(Program &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &) override {};
+  virtual void visit(SignedNumber &) override {};
+  virtual void visit(UnaryOp &) override {};
+  virtual void visit(PrintStmt &) override {};
+
+  virtual void visit(NegExpr &Node) override {
+    check(Node.getExpr());
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    Cost C;
+    if (Node.getOperator() == BinaryOp::Exp && !Loop.empty() && (Node.accept(C), C.hasExpLoop())) {
+      OS << "warning: '" << toString(&Node) << "' is evaluated on every iteration of '" << Loop
+         << "' and runs a loop of up to two multiplications per bit of the exponent; ";
+      describe(OS, C);
+      OS << " per iteration [-Wperf]\n";
+      ++Warnings;
+    }
+    check(Node.getLeft());
+    check(Node.getRight());
+  };
+
+  virtual void visit(Comparison &Node) override {
+    if (Node.getRight()) {
+      check(Node.getLeft());
+      check(Node.getRight());
+    }
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    // CodeGen skips the right operand when the left one decides the result,
+    // so the costly operand should come last. Swapping operands with ++ or --
+    // would change what the program does.
+    if (Node.getRight()) {
+      Cost C, R;
+      Node.getLeft()->accept(C);
+      Node.getRight()->accept(R);
+      if (C.getCycles() >= CostlyOperand && R.getCycles() < CostlyOperand && !C.hasEffects() && !R.hasEffects()) {
+        OS << "warning: '" << toString(&Node) << "' always evaluates '" << toString(Node.getLeft())
+           << "', which the cheaper '" << toString(Node.getRight()) << "' could skip if it came first; ";
+        describe(OS, C);
+        if (!Loop.empty())
+          OS << " on every iteration of '" << Loop << "'";
+        OS << " [-Wperf]\n";
+        ++Warnings;
+      }
+    }
+    check(Node.getLeft());
+    check(Node.getRight());
+  };
+
+  virtual void visit(Assignment &Node) override {
+    check(Node.getRightExpr());
+    check(Node.getRightLogic());
+  };
+
+  virtual void visit(DeclarationInt &Node) override { declaration(Node); };
+  virtual void visit(DeclarationBool &Node) override { declaration(Node); };
+
+  virtual void visit(IfStmt &Node) override {
+    check(Node.getCond());
+    visitBody(Node.begin(), Node.end());
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      (*I)->accept(*this);
+    visitBody(Node.beginElse(), Node.endElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    check(Node.getCond());
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    check(Node.getCond());
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    visitBody(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    loop(Node, nullptr, {Node.getCond()});
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    loop(Node, Node.getFirst(), {Node.getSecond(), Node.getThirdAssign(), Node.getThirdUnary()});
+  };
+};
+}
+
+unsigned PerfLint::check(Program *Tree, llvm::raw_ostream &OS) {
+  nperf::Linter L(OS);
+  Tree->accept(L);
+  return L.getWarnings();
+}
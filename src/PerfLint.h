@@ -0,0 +1,19 @@
+#ifndef PERFLINT_H
+#define PERFLINT_H
+
+#include "AST.h"
+#include "llvm/Support/raw_ostream.h"
+
+class PerfLint
+{
+public:
+  // Warns about the constructs the code generator is known to make slow: '^'
+  // evaluated in a loop, declarations in loop bodies, which initialize their
+  // variables on every iteration, and 'and'/'or' with a costly left operand
+  // and a cheap right one, which could skip the costly one if written first.
+  // Every warning quotes the construct and estimates its cost. Runs on the
+  // tree the code generator gets, so constants folded away are not reported.
+  // Returns the number of warnings written to OS.
+  unsigned check(Program *Tree, llvm::raw_ostream &OS);
+};
+#endif
@@ -0,0 +1,580 @@
+#include "RangeAnalysis.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+namespace nrange{
+// Bounds are kept in 64 bits, so that a 32-bit operation that overflows is
+// noticed instead of producing a wrong interval.
+struct Interval {
+  int64_t Lo;
+  int64_t Hi;
+
+  bool operator==(const Interval &O) const { return Lo == O.Lo && Hi == O.Hi; }
+};
+
+static const Interval Full = {INT32_MIN, INT32_MAX};
+
+// Values outside of 32 bits wrap around, so nothing is known then
+static Interval norm(int64_t Lo, int64_t Hi) {
+  if (Lo < INT32_MIN || Hi > INT32_MAX)
+    return Full;
+  return {Lo, Hi};
+}
+
+static bool isFull(Interval I) { return I.Lo == INT32_MIN && I.Hi == INT32_MAX; }
+
+// Facts are always written, so that running the analysis again replaces them
+static ValueRange toRange(Interval I) { return isFull(I) ? ValueRange() : ValueRange(I.Lo, I.Hi); }
+
+// The intervals of the int variables at a point of the program, keyed by
+// Sema's slot. A variable without an entry can have any value.
+struct State {
+  llvm::DenseMap<unsigned, Interval> Vars;
+  bool Reachable;
+
+  State() : Reachable(true) {}
+
+  Interval get(VarRef R) const {
+    llvm::DenseMap<unsigned, Interval>::const_iterator I = Vars.find(R.getSlot());
+    return I == Vars.end() ? Full : I->second;
+  }
+
+  void set(VarRef R, Interval V) {
+    if (isFull(V))
+      Vars.erase(R.getSlot());
+    else
+      Vars[R.getSlot()] = V;
+  }
+
+  // Narrows a variable to V; an empty interval means the point is unreachable
+  void meet(unsigned Slot, Interval V) {
+    llvm::DenseMap<unsigned, Interval>::iterator I = Vars.find(Slot);
+    if (I != Vars.end())
+      V = {std::max(V.Lo, I->second.Lo), std::min(V.Hi, I->second.Hi)};
+    if (V.Lo > V.Hi)
+      Reachable = false;
+    else if (!isFull(V))
+      Vars[Slot] = V;
+  }
+
+  void meet(const State &O) {
+    if (!O.Reachable)
+      Reachable = false;
+    for (const auto &KV : O.Vars)
+      meet(KV.first, KV.second);
+  }
+
+  void join(const State &O) {
+    if (!O.Reachable)
+      return;
+    if (!Reachable) {
+      *this = O;
+      return;
+    }
+    llvm::SmallVector<unsigned, 8> Unknown;
+    for (auto &KV : Vars) {
+      llvm::DenseMap<unsigned, Interval>::const_iterator I = O.Vars.find(KV.first);
+      if (I == O.Vars.end())
+        Unknown.push_back(KV.first);
+      else
+        KV.second = {std::min(KV.second.Lo, I->second.Lo), std::max(KV.second.Hi, I->second.Hi)};
+    }
+    for (unsigned Slot : Unknown)
+      Vars.erase(Slot);
+  }
+
+  // Sends the bounds that grew since Old to the end of the range, so that
+  // loops reach a fixpoint after a few iterations
+  void widen(const State &Old) {
+    if (!Old.Reachable)
+      return;
+    for (auto &KV : Vars) {
+      Interval O = Old.get(VarRef(VarRef::Int, KV.first));
+      if (KV.second.Lo < O.Lo)
+        KV.second.Lo = INT32_MIN;
+      if (KV.second.Hi > O.Hi)
+        KV.second.Hi = INT32_MAX;
+    }
+  }
+
+  bool operator==(const State &O) const {
+    if (Reachable != O.Reachable || Vars.size() != O.Vars.size())
+      return false;
+    for (const auto &KV : Vars) {
+      llvm::DenseMap<unsigned, Interval>::const_iterator I = O.Vars.find(KV.first);
+      if (I == O.Vars.end() || !(I->second == KV.second))
+        return false;
+    }
+    return true;
+  }
+};
+
+class Analysis : public ASTVisitor {
+  State Cur;        // State at the current point of the walk
+  State TrueState;  // States after the condition visited last, if it holds
+  State FalseState; // and if it does not
+  Interval Val;     // Interval of the expression visited last
+  bool IsVar;       // Whether that expression is an int variable
+  VarRef Var;       // The variable then
+  bool SideEffect;  // Whether a ++ or -- was evaluated since it was last cleared
+  bool Recording;   // Whether this walk is the one whose facts are recorded
+  bool HasError;
+
+  Interval eval(Expr *E) {
+    E->accept(*this);
+    return Val;
+  }
+
+  // Evaluates C and sets TrueState and FalseState
+  void cond(Logic *C) {
+    if (!Cur.Reachable) {
+      TrueState = FalseState = Cur;
+      return;
+    }
+    C->accept(*this);
+  }
+
+  void divisionByZero() {
+    llvm::errs() << "Division by zero is not allowed." << "\n";
+    HasError = true;
+  }
+
+  // Interval of L Op R. NonNeg is set if the operands and the result are
+  // never negative, which makes the unsigned forms of the operation valid.
+  Interval arith(BinaryOp::Operator Op, Interval L, Interval R, bool &NonNeg) {
+    Interval Res = Full;
+    switch (Op)
+    {
+    case BinaryOp::Plus:
+      Res = norm(L.Lo + R.Lo, L.Hi + R.Hi);
+      break;
+    case BinaryOp::Minus:
+      Res = norm(L.Lo - R.Hi, L.Hi - R.Lo);
+      break;
+    case BinaryOp::Mul: {
+      int64_t P[] = {L.Lo * R.Lo, L.Lo * R.Hi, L.Hi * R.Lo, L.Hi * R.Hi};
+      Res = norm(*std::min_element(P, P + 4), *std::max_element(P, P + 4));
+      break;
+    }
+    case BinaryOp::Div: {
+      // The quotient is monotonic on either side of zero, so the corners of
+      // the negative and the positive part of the divisor bound it
+      if (R.Lo == 0 && R.Hi == 0) {
+        if (Recording)
+          divisionByZero();
+        break;
+      }
+      int64_t Lo = INT64_MAX, Hi = INT64_MIN;
+      Interval Parts[] = {{R.Lo, std::min<int64_t>(R.Hi, -1)}, {std::max<int64_t>(R.Lo, 1), R.Hi}};
+      for (Interval D : Parts) {
+        if (D.Lo > D.Hi)
+          continue;
+        int64_t Q[] = {L.Lo / D.Lo, L.Lo / D.Hi, L.Hi / D.Lo, L.Hi / D.Hi};
+        Lo = std::min(Lo, *std::min_element(Q, Q + 4));
+        Hi = std::max(Hi, *std::max_element(Q, Q + 4));
+      }
+      Res = norm(Lo, Hi);
+      break;
+    }
+    case BinaryOp::Mod: {
+      // The remainder has the sign of the dividend and is smaller than the divisor
+      if (R.Lo == 0 && R.Hi == 0) {
+        if (Recording)
+          divisionByZero();
+        break;
+      }
+      int64_t M = std::max(-R.Lo, R.Hi) - 1;
+      Res = {std::max(std::min<int64_t>(L.Lo, 0), -M), std::min(std::max<int64_t>(L.Hi, 0), M)};
+      break;
+    }
+    case BinaryOp::Exp: {
+      // CreateExp gives 1 for exponents <= 0 and grows with a base >= 0
+      if (R.Hi <= 0) {
+        Res = {1, 1};
+        break;
+      }
+      if (L.Lo < 0)
+        break;
+      int64_t Max = 1;
+      for (int64_t E = 0; E < R.Hi && Max <= INT32_MAX && L.Hi > 1; ++E)
+        Max *= L.Hi;
+      int64_t Min = L.Lo == 0 ? 0 : 1;
+      for (int64_t E = 0; E < R.Lo && Min <= INT32_MAX && L.Lo > 1; ++E)
+        Min *= L.Lo;
+      Res = norm(Min, std::max<int64_t>(Max, 1));
+      break;
+    }
+    default:
+      break;
+    }
+    NonNeg = L.Lo >= 0 && R.Lo >= 0 && Res.Lo >= 0 && Op != BinaryOp::Exp;
+    return Res;
+  }
+
+  // Narrows S to the values for which L Op R holds; LVar and RVar say which
+  // sides are variables
+  static void refine(State &S, Comparison::Operator Op, bool LVar, VarRef L, Interval LI, bool RVar, VarRef R, Interval RI) {
+    Interval NewL = LI, NewR = RI;
+    switch (Op)
+    {
+    case Comparison::Less:
+      NewL.Hi = std::min(LI.Hi, RI.Hi - 1);
+      NewR.Lo = std::max(RI.Lo, LI.Lo + 1);
+      break;
+    case Comparison::Less_equal:
+      NewL.Hi = std::min(LI.Hi, RI.Hi);
+      NewR.Lo = std::max(RI.Lo, LI.Lo);
+      break;
+    case Comparison::Greater:
+      NewL.Lo = std::max(LI.Lo, RI.Lo + 1);
+      NewR.Hi = std::min(RI.Hi, LI.Hi - 1);
+      break;
+    case Comparison::Greater_equal:
+      NewL.Lo = std::max(LI.Lo, RI.Lo);
+      NewR.Hi = std::min(RI.Hi, LI.Hi);
+      break;
+    case Comparison::Equal:
+      NewL = NewR = {std::max(LI.Lo, RI.Lo), std::min(LI.Hi, RI.Hi)};
+      break;
+    case Comparison::Not_equal:
+      // Only a constant at the edge of the other side removes a value
+      if (RI.Lo == RI.Hi && RI.Lo == LI.Lo)
+        ++NewL.Lo;
+      else if (RI.Lo == RI.Hi && RI.Lo == LI.Hi)
+        --NewL.Hi;
+      if (LI.Lo == LI.Hi && LI.Lo == RI.Lo)
+        ++NewR.Lo;
+      else if (LI.Lo == LI.Hi && LI.Lo == RI.Hi)
+        --NewR.Hi;
+      break;
+    default:
+      return;
+    }
+    if (NewL.Lo > NewL.Hi || NewR.Lo > NewR.Hi)
+      S.Reachable = false;
+    if (LVar)
+      S.meet(L.getSlot(), NewL);
+    if (RVar)
+      S.meet(R.getSlot(), NewR);
+  }
+
+  static Comparison::Operator negate(Comparison::Operator Op) {
+    switch (Op)
+    {
+    case Comparison::Less:
+      return Comparison::Greater_equal;
+    case Comparison::Less_equal:
+      return Comparison::Greater;
+    case Comparison::Greater:
+      return Comparison::Less_equal;
+    case Comparison::Greater_equal:
+      return Comparison::Less;
+    case Comparison::Equal:
+      return Comparison::Not_equal;
+    case Comparison::Not_equal:
+      return Comparison::Equal;
+    default:
+      return Op;
+    }
+  }
+
+  void run(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E && Cur.Reachable; ++I)
+      (*I)->accept(*this);
+  }
+
+  // Analyzes a loop, of which Cur is the state on entry. Body walks the
+  // statements of one iteration. Leaves in Cur the state on exit.
+  template <typename BodyFn>
+  void loop(Logic *Cond, BodyFn Body) {
+    if (!Cur.Reachable)
+      return;
+    State Entry = Cur, Head = Cur;
+    bool Rec = Recording;
+    Recording = false;
+    for (;;) {
+      Cur = Head;
+      cond(Cond);
+      Cur = TrueState;
+      Body(false);
+      State Next = Head;
+      Next.join(Cur);
+      Next.widen(Head);
+      if (Next == Head)
+        break;
+      Head = std::move(Next);
+    }
+    // One more iteration from the fixpoint narrows the bounds widening lost
+    Cur = Head;
+    cond(Cond);
+    Cur = TrueState;
+    Body(false);
+    Head = Entry;
+    Head.join(Cur);
+
+    Recording = Rec;
+    Cur = Head;
+    cond(Cond);
+    State Exit = FalseState;
+    Cur = TrueState;
+    Body(true);
+    Cur = std::move(Exit);
+  }
+
+public:
+  Analysis() : Val(Full), IsVar(false), SideEffect(false), Recording(true), HasError(false) {}
+
+  bool hasError() { return HasError; }
+
+  virtual void visit(Program &Node) override {
+    run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &Node) override {
+    IsVar = false;
+    int32_t V;
+    if (Node.getKind() == Final::Number) {
+      Val = Node.getVal().getAsInteger(10, V) ? Full : Interval{V, V};
+      return;
+    }
+    Val = Cur.get(Node.getRef());
+    IsVar = true;
+    Var = Node.getRef();
+    if (Recording)
+      Node.setRange(toRange(Val));
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    IsVar = false;
+    int32_t V;
+    if (Node.getValue().getAsInteger(10, V))
+      Val = Full;
+    else
+      Val = Node.getSign() == SignedNumber::Minus ? norm(-(int64_t)V, -(int64_t)V) : Interval{V, V};
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    Interval Old = Cur.get(Node.getRef());
+    int64_t D = Node.getOperator() == UnaryOp::Plus_plus ? 1 : -1;
+    Val = norm(Old.Lo + D, Old.Hi + D);
+    Cur.set(Node.getRef(), Val);
+    if (Recording)
+      Node.setNonNegative(Old.Lo >= 0 && Val.Lo >= 0);
+    IsVar = false;
+    SideEffect = true;
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    Interval V = eval(Node.getExpr());
+    Val = norm(-V.Hi, -V.Lo);
+    IsVar = false;
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    Interval L = eval(Node.getLeft());
+    Interval R = eval(Node.getRight());
+    bool NonNeg;
+    Val = arith(Node.getOperator(), L, R, NonNeg);
+    if (Recording)
+      Node.setNonNegative(NonNeg);
+    IsVar = false;
+  };
+
+  virtual void visit(Comparison &Node) override {
+    switch (Node.getOperator())
+    {
+    case Comparison::True:
+      TrueState = Cur;
+      FalseState.Reachable = false;
+      return;
+    case Comparison::False:
+      TrueState.Reachable = false;
+      FalseState = Cur;
+      return;
+    case Comparison::Ident:
+      TrueState = FalseState = Cur;
+      return;
+    default:
+      break;
+    }
+    bool OuterEffect = SideEffect;
+    SideEffect = false;
+    Interval LI = eval(Node.getLeft());
+    bool LVar = IsVar;
+    VarRef L = Var;
+    Interval RI = eval(Node.getRight());
+    bool RVar = IsVar;
+    VarRef R = Var;
+    TrueState = FalseState = Cur;
+    // A ++ or -- in the operands may have changed what was read
+    if (!SideEffect) {
+      refine(TrueState, Node.getOperator(), LVar, L, LI, RVar, R, RI);
+      refine(FalseState, negate(Node.getOperator()), LVar, L, LI, RVar, R, RI);
+    }
+    SideEffect |= OuterEffect;
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    Node.getLeft()->accept(*this);
+    if (!Node.getRight())
+      return;
+    // The right operand only runs where the left one does not decide, so it
+    // starts from the state in which the left one leaves the result open
+    bool And = Node.getOperator() == LogicalExpr::And;
+    State Decided = And ? FalseState : TrueState;
+    Cur = And ? TrueState : FalseState;
+    cond(Node.getRight());
+    if (And)
+      FalseState.join(Decided);
+    else
+      TrueState.join(Decided);
+    Cur.join(Decided);
+  };
+
+  virtual void visit(Assignment &Node) override {
+    VarRef Ref = Node.getLeft()->getRef();
+    if (!Node.getRightExpr()) {
+      cond(Node.getRightLogic());
+      // An int variable assigned another one, `x = y`, parses as a condition
+      if (!Ref.isBool())
+        Cur.set(Ref, Full);
+      return;
+    }
+    Interval R = eval(Node.getRightExpr());
+    Interval L = Cur.get(Ref);
+    if (Recording)
+      Node.getLeft()->setRange(toRange(L));
+    bool NonNeg = false;
+    switch (Node.getAssignKind())
+    {
+    case Assignment::Plus_assign:
+      R = arith(BinaryOp::Plus, L, R, NonNeg);
+      break;
+    case Assignment::Minus_assign:
+      R = arith(BinaryOp::Minus, L, R, NonNeg);
+      break;
+    case Assignment::Star_assign:
+      R = arith(BinaryOp::Mul, L, R, NonNeg);
+      break;
+    case Assignment::Slash_assign:
+      R = arith(BinaryOp::Div, L, R, NonNeg);
+      break;
+    default:
+      break;
+    }
+    if (Recording)
+      Node.setNonNegative(NonNeg);
+    Cur.set(Ref, R);
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    // All initializers are evaluated before any of the variables is stored
+    llvm::SmallVector<Interval, 8> Vals;
+    for (llvm::SmallVector<Expr *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      Vals.push_back(*I ? eval(*I) : Full);
+    for (unsigned I = 0, E = Vals.size(); I != E; ++I)
+      Cur.set(Node.getRef(I), Vals[I]);
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    for (llvm::SmallVector<Logic *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      if (*I)
+        cond(*I);
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    cond(Node.getCond());
+    State Else = FalseState;
+    Cur = TrueState;
+    run(Node.begin(), Node.end());
+    State Out = Cur;
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I) {
+      Cur = Else;
+      cond((*I)->getCond());
+      Else = FalseState;
+      Cur = TrueState;
+      (*I)->accept(*this);
+      Out.join(Cur);
+    }
+    Cur = Else;
+    run(Node.beginElse(), Node.endElse());
+    Out.join(Cur);
+    Cur = std::move(Out);
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    Interval CI = eval(Node.getCond());
+    bool CVar = IsVar;
+    VarRef CV = Var;
+    State Dispatch = Cur;
+
+    // Where no label matches. Each label removes a value at an edge of the
+    // interval, so going through them in order from both ends removes a run.
+    State Unmatched = Cur;
+    llvm::SmallVector<int32_t, 8> Labels;
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I)
+      if (!(*I)->isDefault())
+        Labels.push_back((*I)->getLiteral());
+    std::sort(Labels.begin(), Labels.end());
+    if (CVar) {
+      for (int32_t L : Labels)
+        refine(Unmatched, Comparison::Not_equal, true, CV, Unmatched.get(CV), false, VarRef(), Interval{L, L});
+      for (llvm::SmallVector<int32_t, 8>::reverse_iterator I = Labels.rbegin(), E = Labels.rend(); I != E; ++I)
+        refine(Unmatched, Comparison::Not_equal, true, CV, Unmatched.get(CV), false, VarRef(), Interval{*I, *I});
+    }
+
+    // An arm is entered from the dispatch, where the expression equals its
+    // label, or falls through from the arm before it
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I) {
+      State Entry = Unmatched;
+      if (!(*I)->isDefault()) {
+        Entry = Dispatch;
+        Interval L = {(*I)->getLiteral(), (*I)->getLiteral()};
+        refine(Entry, Comparison::Equal, CVar, CV, CI, false, VarRef(), L);
+      }
+      if (I != Node.begin())
+        Entry.join(Cur);
+      Cur = std::move(Entry);
+      (*I)->accept(*this);
+    }
+    if (!Node.getDefault())
+      Cur.join(Unmatched);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    loop(Node.getCond(), [&](bool) { run(Node.begin(), Node.end()); });
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    Node.getFirst()->accept(*this);
+    VarRef Ind = Node.getFirst()->getLeft()->getRef();
+    loop(Node.getSecond(), [&](bool Last) {
+      if (Last && Recording)
+        Node.setBodyRange(Cur.Reachable && !Ind.isBool() ? toRange(Cur.get(Ind)) : ValueRange());
+      run(Node.begin(), Node.end());
+      if (Node.getThirdAssign())
+        Node.getThirdAssign()->accept(*this);
+      else
+        Node.getThirdUnary()->accept(*this);
+    });
+  };
+};
+}
+
+bool RangeAnalysis::analyze(Program *Tree) {
+  nrange::Analysis A;
+  Tree->accept(A);
+  return A.hasError();
+}
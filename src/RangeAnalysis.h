@@ -0,0 +1,19 @@
+#ifndef RANGEANALYSIS_H
+#define RANGEANALYSIS_H
+
+#include "AST.h"
+#include "PassManager.h"
+
+class RangeAnalysis : public ASTPass
+{
+public:
+  // Computes the interval each int variable is in at every point of the
+  // program, narrowing it at branches and widening it at loops, and records
+  // on the tree what the code generator can use: the ranges of loaded
+  // variables and of for-loop induction variables, and which arithmetic
+  // never sees a negative value. Returns true if a divisor is always zero.
+  bool analyze(Program *Tree);
+
+  bool run(Program *Tree) override { return analyze(Tree); }
+};
+#endif
@@ -0,0 +1,13 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+// The runtime the generated code calls, from rtCompiler.c. It is linked into
+// the compiler too, for the code run in process and for TieredRunner.
+extern "C" {
+void print_int(int);
+void print_bool(int);
+void print_str(const char *);
+int compiler_read(char *);
+void par_for(void (*)(void *, long long, long long, int), void *, long long, long long);
+}
+#endif
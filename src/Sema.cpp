@@ -1,29 +1,244 @@
 #include "Sema.h"
-#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/DJB.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 
 
 namespace nms{
+
+// SymbolTable keeps the variables visible at the current point of the walk.
+// All scopes share one open-addressed hash table, so resolving a name is a
+// single probe sequence no matter how deeply blocks are nested. Declarations
+// are also kept on a stack in declaration order; leaving a scope pops the
+// declarations made at its depth and clears their buckets. Because buckets are
+// only ever removed in reverse insertion order, linear probing needs no
+// tombstones. Storage slots of popped variables are handed out again to later
+// declarations of the same type.
+class SymbolTable {
+public:
+  struct Symbol {
+    llvm::StringRef Name;
+    VarRef Ref;
+    unsigned Depth; // Scope depth of the declaration, 0 for the program level
+    unsigned Hash;
+  };
+
+private:
+  llvm::SmallVector<Symbol> Symbols;     // Visible declarations, innermost last
+  llvm::SmallVector<unsigned, 64> Table; // Index + 1 into Symbols, 0 for an empty bucket
+  unsigned Depth;
+  llvm::SmallVector<unsigned> FreeIntSlots;  // Slots of int variables whose scope has ended
+  llvm::SmallVector<unsigned> FreeBoolSlots; // Slots of bool variables whose scope has ended
+  unsigned NumIntSlots;  // Number of int slots handed out so far
+  unsigned NumBoolSlots; // Number of bool slots handed out so far
+
+  // Returns the bucket holding Name, or the empty bucket where it would go
+  unsigned findBucket(llvm::StringRef Name, unsigned Hash) {
+    unsigned Mask = Table.size() - 1;
+    for (unsigned B = Hash & Mask;; B = (B + 1) & Mask) {
+      if (Table[B] == 0)
+        return B;
+      Symbol &S = Symbols[Table[B] - 1];
+      if (S.Hash == Hash && S.Name == Name)
+        return B;
+    }
+  }
+
+  // Doubles the table, reinserting in declaration order to keep pops valid
+  void grow() {
+    Table.assign(Table.size() * 2, 0);
+    for (unsigned I = 0, E = Symbols.size(); I != E; ++I)
+      Table[findBucket(Symbols[I].Name, Symbols[I].Hash)] = I + 1;
+  }
+
+public:
+  SymbolTable(unsigned FirstIntSlot = 0, unsigned FirstBoolSlot = 0)
+      : Table(64, 0), Depth(0), NumIntSlots(FirstIntSlot), NumBoolSlots(FirstBoolSlot) {}
+
+  unsigned getDepth() { return Depth; }
+
+  // Returns the declaration of Name visible from the current scope, or null
+  Symbol *lookup(llvm::StringRef Name) {
+    unsigned B = findBucket(Name, llvm::djbHash(Name));
+    return Table[B] ? &Symbols[Table[B] - 1] : nullptr;
+  }
+
+  // Declares Name in the current scope; the caller checks for conflicts first
+  VarRef declare(llvm::StringRef Name, VarRef::VarType Type) {
+    if ((Symbols.size() + 1) * 2 > Table.size())
+      grow();
+    llvm::SmallVector<unsigned> &Free = Type == VarRef::Bool ? FreeBoolSlots : FreeIntSlots;
+    unsigned Slot;
+    if (!Free.empty())
+      Slot = Free.pop_back_val();
+    else
+      Slot = Type == VarRef::Bool ? NumBoolSlots++ : NumIntSlots++;
+    unsigned Hash = llvm::djbHash(Name);
+    Symbols.push_back({Name, VarRef(Type, Slot), Depth, Hash});
+    Table[findBucket(Name, Hash)] = Symbols.size();
+    return Symbols.back().Ref;
+  }
+
+  void pushScope() { ++Depth; }
+
+  void popScope() {
+    while (!Symbols.empty() && Symbols.back().Depth == Depth) {
+      Symbol &S = Symbols.back();
+      Table[findBucket(S.Name, S.Hash)] = 0;
+      (S.Ref.isBool() ? FreeBoolSlots : FreeIntSlots).push_back(S.Ref.getSlot());
+      Symbols.pop_back();
+    }
+    --Depth;
+  }
+};
+
+// A variable declared by a top-level statement, recorded by the serial first
+// phase of the parallel mode together with the index of its statement
+struct TopLevelDecl {
+  VarRef Ref;
+  unsigned Pos;
+};
+
+using TopLevelDecls = llvm::StringMap<TopLevelDecl>;
+
+// Tells whether an expression is a bare integer literal, and its value, or a
+// bare variable. Case labels must be literals, and a switch cannot dispatch on
+// a boolean variable.
+class BareOperand : public ASTVisitor {
+public:
+  bool IsLiteral;
+  int32_t Literal;
+  Final *Var;
+
+  void inspect(Expr *E) {
+    IsLiteral = false;
+    Var = nullptr;
+    E->accept(*this);
+  }
+
+  // The literal has to fit in 32 bits once its sign is applied
+  void literal(llvm::StringRef Text, bool Negative) {
+    int64_t Val;
+    if (Text.getAsInteger(10, Val))
+      return;
+    Val = Negative ? -Val : Val;
+    IsLiteral = Val >= INT32_MIN && Val <= INT32_MAX;
+    Literal = (int32_t)Val;
+  }
+
+  virtual void visit(Final &Node) override {
+    if (Node.getKind() == Final::Ident)
+      Var = &Node;
+    else
+      literal(Node.getVal(), false);
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    literal(Node.getValue(), Node.getSign() == SignedNumber::Minus);
+  };
+
+  virtual void visit(BinaryOp &) override {};
+  virtual void visit(UnaryOp &) override {};
+  virtual void visit(NegExpr &) override {};
+  virtual void visit(Assignment &) override {};
+  virtual void visit(DeclarationInt &) override {};
+  virtual void visit(DeclarationBool &) override {};
+  virtual void visit(Comparison &) override {};
+  virtual void visit(LogicalExpr &) override {};
+  virtual void visit(IfStmt &) override {};
+  virtual void visit(WhileStmt &) override {};
+  virtual void visit(elifStmt &) override {};
+  virtual void visit(ForStmt &) override {};
+  virtual void visit(PrintStmt &) override {};
+  virtual void visit(SwitchStmt &) override {};
+  virtual void visit(CaseStmt &) override {};
+};
+
 class InputCheck : public ASTVisitor {
-  llvm::StringSet<> IntScope; // StringSet to store declared int variables
-  llvm::StringSet<> BoolScope;
+  SymbolTable Symbols; // Variables visible at the current point
+  llvm::raw_ostream &Diag; // Stream the diagnostics are written to
+  const TopLevelDecls *Globals; // Top-level declarations in parallel mode, null otherwise
+  unsigned Pos; // Index of the top-level statement being checked in parallel mode
   bool HasError; // Flag to indicate if an error occurred
 
   enum ErrorType { Twice, Not }; // Enum to represent error types: Twice - variable declared twice, Not - variable not declared
 
   void error(ErrorType ET, llvm::StringRef V) {
     // Function to report errors
-    llvm::errs() << "Variable " << V << " is "
+    Diag << "Variable " << V << " is "
                  << (ET == Twice ? "already" : "not")
                  << " declared\n";
     HasError = true; // Set error flag to true
   }
 
+  // Resolves an identifier to the storage of its declaration
+  VarRef lookup(llvm::StringRef Name) {
+    if (SymbolTable::Symbol *S = Symbols.lookup(Name))
+      return S->Ref;
+    if (Globals) {
+      // Top-level declarations are visible from the statement after them on
+      TopLevelDecls::const_iterator I = Globals->find(Name);
+      if (I != Globals->end() && I->second.Pos < Pos)
+        return I->second.Ref;
+    }
+    return VarRef();
+  }
+
+  void redeclared(llvm::StringRef Name, VarRef::VarType Type, VarRef Visible) {
+    if (Visible.getType() != Type) {
+      Diag << "Variable " << Name << " is already declared as an "
+                   << (Visible.isBool() ? "boolean" : "integer") << "\n";
+      HasError = true;
+    }
+    else
+      error(Twice, Name); // The name is already visible, report a "Twice" error
+  }
+
+  // Declares a variable unless the name is already visible
+  VarRef declare(llvm::StringRef Name, VarRef::VarType Type, VarRef Declared) {
+    if (Globals && Symbols.getDepth() == 0) {
+      // The first phase has declared the top-level variables already; an
+      // unresolved slot marks a name that was taken by an earlier declaration
+      if (Declared.getType() == VarRef::Unresolved)
+        redeclared(Name, Type, Globals->find(Name)->second.Ref);
+      return Declared;
+    }
+    VarRef Visible = lookup(Name);
+    if (Visible.getType() == VarRef::Unresolved)
+      return Symbols.declare(Name, Type);
+    redeclared(Name, Type, Visible);
+    return VarRef();
+  }
+
+  // Visits the statements of a block in a scope of their own
+  void visitBlock(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    Symbols.pushScope();
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+    Symbols.popScope();
+  }
+
 public:
-  InputCheck() : HasError(false) {} // Constructor
+  InputCheck(llvm::raw_ostream &Diag) : Diag(Diag), Globals(nullptr), Pos(0), HasError(false) {} // Constructor
+
+  // Constructor for checking a chunk of top-level statements in parallel mode;
+  // slots for nested declarations are numbered after the top-level ones
+  InputCheck(llvm::raw_ostream &Diag, const TopLevelDecls &Globals, unsigned NumIntSlots, unsigned NumBoolSlots)
+      : Symbols(NumIntSlots, NumBoolSlots), Diag(Diag), Globals(&Globals), Pos(0), HasError(false) {}
+
+  // Checks the top-level statements [Begin, End) of the program
+  void checkRange(Program &Node, unsigned Begin, unsigned End) {
+    for (Pos = Begin; Pos != End; ++Pos)
+      Node.begin()[Pos]->accept(*this);
+  }
 
   bool hasError() { return HasError; } // Function to check if an error occurred
 
+  // Declares a top-level variable of an earlier statement
+  void declareVisible(llvm::StringRef Name, VarRef::VarType Type) { Symbols.declare(Name, Type); }
+
   // Visit function for Program nodes
   virtual void visit(Program &Node) override { 
 
@@ -40,9 +255,11 @@ public:
   // Visit function for Final nodes
   virtual void visit(Final &Node) override {
     if (Node.getKind() == Final::Ident) {
-      // Check if identifier is in the scope
-      if (IntScope.find(Node.getVal()) == IntScope.end() && BoolScope.find(Node.getVal()) == BoolScope.end())
+      // Check if identifier is in the scope and record its storage on the node
+      VarRef Ref = lookup(Node.getVal());
+      if (Ref.getType() == VarRef::Unresolved)
         error(Not, Node.getVal());
+      Node.setRef(Ref);
     }
   };
 
@@ -62,16 +279,16 @@ public:
 
     Final* l = (Final*)left;
     if (l->getKind() == Final::Ident){
-      if (BoolScope.find(l->getVal()) != BoolScope.end()) {
-        llvm::errs() << "Cannot use binary operation on a boolean variable: " << l->getVal() << "\n";
+      if (l->getRef().isBool()) {
+        Diag << "Cannot use binary operation on a boolean variable: " << l->getVal() << "\n";
         HasError = true;
       }
     }
 
     Final* r = (Final*)right;
     if (r->getKind() == Final::Ident){
-      if (BoolScope.find(r->getVal()) != BoolScope.end()) {
-        llvm::errs() << "Cannot use binary operation on a boolean variable: " << r->getVal() << "\n";
+      if (r->getRef().isBool()) {
+        Diag << "Cannot use binary operation on a boolean variable: " << r->getVal() << "\n";
         HasError = true;
       }
     }
@@ -84,7 +301,7 @@ public:
         llvm::StringRef intval = f->getVal();
 
         if (intval == "0") {
-          llvm::errs() << "Division by zero is not allowed." << "\n";
+          Diag << "Division by zero is not allowed." << "\n";
           HasError = true;
         }
       }
@@ -101,26 +318,26 @@ public:
     dest->accept(*this);
 
     if (dest->getKind() == Final::Number) {
-        llvm::errs() << "Assignment destination must be an identifier, not a number.";
+        Diag << "Assignment destination must be an identifier, not a number.";
         HasError = true;
     }
 
-    if (BoolScope.find(dest->getVal()) != BoolScope.end()) {
+    if (dest->getRef().isBool()) {
       RightLogic = Node.getRightLogic();
       if (RightLogic){
         RightLogic->accept(*this);
         if(Node.getAssignKind() != Assignment::AssignKind::Assign){
-          llvm::errs() << "Cannot use mathematical operation on boolean variable: " << dest->getVal() << "\n";
+          Diag << "Cannot use mathematical operation on boolean variable: " << dest->getVal() << "\n";
           HasError = true;
         }
       }
       else{
-        llvm::errs() << "you should assign a boolean value to boolean variable: " << dest->getVal() << "\n";
+        Diag << "you should assign a boolean value to boolean variable: " << dest->getVal() << "\n";
         HasError = true;
       }
     }
       
-    else if (IntScope.find(dest->getVal()) != IntScope.end()){
+    else if (dest->getRef().getType() == VarRef::Int){
       RightExpr = Node.getRightExpr();
       RightLogic = Node.getRightLogic();
       if (RightExpr){
@@ -132,20 +349,20 @@ public:
         if (RL){
           if (RL->getOperator() == Comparison::Ident){
             Final* F = (Final*)(RL->getLeft());
-            if (IntScope.find(F->getVal()) == IntScope.end()) {
-              llvm::errs() << "you should assign an integer value to an integer variable: " << dest->getVal() << "\n";
+            if (F->getRef().getType() != VarRef::Int) {
+              Diag << "you should assign an integer value to an integer variable: " << dest->getVal() << "\n";
               HasError = true;
             } 
           }
           else{
-            llvm::errs() << "you should assign an integer value to an integer variable: " << dest->getVal() << "\n";
+            Diag << "you should assign an integer value to an integer variable: " << dest->getVal() << "\n";
             HasError = true;
           }
         }
         
       }
       else{
-        llvm::errs() << "you should assign an integer value to an integer variable: " << dest->getVal() << "\n";
+        Diag << "you should assign an integer value to an integer variable: " << dest->getVal() << "\n";
         HasError = true;
       }
         
@@ -161,7 +378,7 @@ public:
         llvm::StringRef intval = f->getVal();
 
         if (intval == "0") {
-          llvm::errs() << "Division by zero is not allowed." << "\n";
+          Diag << "Division by zero is not allowed." << "\n";
           HasError = true;
         }
         }
@@ -173,16 +390,10 @@ public:
     for (llvm::SmallVector<Expr *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I){
       (*I)->accept(*this); // If the Declaration node has an expression, recursively visit the expression node
     }
+    unsigned Idx = 0;
     for (llvm::SmallVector<llvm::StringRef>::const_iterator I = Node.varBegin(), E = Node.varEnd(); I != E;
-         ++I) {
-      if(BoolScope.find(*I) != BoolScope.end()){
-        llvm::errs() << "Variable " << *I << " is already declared as an boolean" << "\n";
-        HasError = true; 
-      }
-      else{
-        if (!IntScope.insert(*I).second)
-          error(Twice, *I); // If the insertion fails (element already exists in Scope), report a "Twice" error
-      }
+         ++I, ++Idx) {
+      Node.setRef(Idx, declare(*I, VarRef::Int, Node.getRef(Idx)));
     }
   };
 
@@ -190,16 +401,10 @@ public:
     for (llvm::SmallVector<Logic *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I){
       (*I)->accept(*this); // If the Declaration node has an expression, recursively visit the expression node
     }
+    unsigned Idx = 0;
     for (llvm::SmallVector<llvm::StringRef>::const_iterator I = Node.varBegin(), E = Node.varEnd(); I != E;
-         ++I) {
-      if(IntScope.find(*I) != IntScope.end()){
-        llvm::errs() << "Variable " << *I << " is already declared as an integer" << "\n";
-        HasError = true; 
-      }
-      else{
-        if (!BoolScope.insert(*I).second)
-          error(Twice, *I); // If the insertion fails (element already exists in Scope), report a "Twice" error
-      }
+         ++I, ++Idx) {
+      Node.setRef(Idx, declare(*I, VarRef::Bool, Node.getRef(Idx)));
     }
     
   };
@@ -215,7 +420,7 @@ public:
     //   if (Node.getOperator() == Comparison::Ident){
     //     Final* F = (Final*)(Node.getLeft());
     //     if (BoolScope.find(F->getVal()) == BoolScope.end()) {
-    //       llvm::errs() << "you need a boolean varaible to compare or assign: "<< F->getVal() << "\n";
+    //       Diag << "you need a boolean varaible to compare or assign: "<< F->getVal() << "\n";
     //       HasError = true;
     //     } 
     //   }
@@ -224,16 +429,16 @@ public:
     if (Node.getOperator() != Comparison::True && Node.getOperator() != Comparison::False && Node.getOperator() != Comparison::Ident){
       Final* L = (Final*)(Node.getLeft());
       if(L){
-        if (L->getKind() == Final::ValueKind::Ident && IntScope.find(L->getVal()) == IntScope.end()) {
-          llvm::errs() << "you can only compare a defined integer variable: "<< L->getVal() << "\n";
+        if (L->getKind() == Final::ValueKind::Ident && L->getRef().getType() != VarRef::Int) {
+          Diag << "you can only compare a defined integer variable: "<< L->getVal() << "\n";
           HasError = true;
         } 
       }
       
       Final* R = (Final*)(Node.getRight());
       if(R){
-        if (R->getKind() == Final::ValueKind::Ident && IntScope.find(R->getVal()) == IntScope.end()) {
-          llvm::errs() << "you can only compare a defined integer variable: "<< R->getVal() << "\n";
+        if (R->getKind() == Final::ValueKind::Ident && R->getRef().getType() != VarRef::Int) {
+          Diag << "you can only compare a defined integer variable: "<< R->getVal() << "\n";
           HasError = true;
         } 
       }
@@ -250,10 +455,12 @@ public:
   };
 
   virtual void visit(UnaryOp &Node) override {
-    if (IntScope.find(Node.getIdent()) == IntScope.end()){
-      llvm::errs() << "Variable "<<Node.getIdent() << " is not a defined integer variable." << "\n";
+    VarRef Ref = lookup(Node.getIdent());
+    if (Ref.getType() != VarRef::Int){
+      Diag << "Variable "<<Node.getIdent() << " is not a defined integer variable." << "\n";
       HasError = true;
     }
+    Node.setRef(Ref);
   };
 
   virtual void visit(NegExpr &Node) override {
@@ -262,22 +469,20 @@ public:
   };
 
   virtual void visit(PrintStmt &Node) override {
-    // Check if identifier is in the scope
-    if (IntScope.find(Node.getVar()) == IntScope.end() && BoolScope.find(Node.getVar()) == BoolScope.end())
+    // Check if identifier is in the scope and record its storage on the node
+    VarRef Ref = lookup(Node.getVar());
+    if (Ref.getType() == VarRef::Unresolved)
       error(Not, Node.getVar());
-    
+    Node.setRef(Ref);
+
   };
 
   virtual void visit(IfStmt &Node) override {
     Logic *l = Node.getCond();
     (*l).accept(*this);
 
-    for (llvm::SmallVector<AST *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I) {
-      (*I)->accept(*this);
-    }
-    for (llvm::SmallVector<AST *>::const_iterator I = Node.beginElse(), E = Node.endElse(); I != E; ++I){
-      (*I)->accept(*this);
-    }
+    visitBlock(Node.begin(), Node.end());
+    visitBlock(Node.beginElse(), Node.endElse());
     for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I){
       (*I)->accept(*this);
     }
@@ -287,18 +492,14 @@ public:
     Logic* l = Node.getCond();
     (*l).accept(*this);
 
-    for (llvm::SmallVector<AST *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I) {
-      (*I)->accept(*this);
-    }
+    visitBlock(Node.begin(), Node.end());
   };
 
   virtual void visit(WhileStmt &Node) override {
     Logic* l = Node.getCond();
     (*l).accept(*this);
 
-    for (llvm::SmallVector<AST *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I) {
-      (*I)->accept(*this);
-    }
+    visitBlock(Node.begin(), Node.end());
   };
 
   virtual void visit(ForStmt &Node) override {
@@ -317,22 +518,152 @@ public:
     }
       
 
-    for (llvm::SmallVector<AST *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I) {
-      (*I)->accept(*this);
+    visitBlock(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    Expr *Cond = Node.getCond();
+    Cond->accept(*this);
+
+    BareOperand Operand;
+    Operand.inspect(Cond);
+    if (Operand.Var && Operand.Var->getRef().isBool()) {
+      Diag << "Cannot switch on a boolean variable: " << Operand.Var->getVal() << "\n";
+      HasError = true;
+    }
+
+    // The labels become the cases of one SwitchInst, so they must be distinct
+    // constants
+    llvm::SmallVector<int32_t> Seen;
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I) {
+      CaseStmt *C = *I;
+      if (!C->isDefault()) {
+        Operand.inspect(C->getValue());
+        if (!Operand.IsLiteral) {
+          Diag << "Case label must be an integer literal" << "\n";
+          HasError = true;
+        }
+        else if (llvm::is_contained(Seen, Operand.Literal)) {
+          Diag << "Duplicate case label: " << Operand.Literal << "\n";
+          HasError = true;
+        }
+        else {
+          Seen.push_back(Operand.Literal);
+          C->setLiteral(Operand.Literal);
+        }
+      }
+      C->accept(*this);
     }
   };
 
+  virtual void visit(CaseStmt &Node) override {
+    visitBlock(Node.begin(), Node.end());
+  };
+
   virtual void visit(SignedNumber &Node) override {
   };
 
 };
+
+// First phase of the parallel mode: declares the variables of all top-level
+// declarations in source order and hands them their slots. Redeclarations are
+// left unresolved and reported by the second phase at their position.
+class TopLevelCollector : public ASTVisitor {
+  TopLevelDecls &Globals;
+  unsigned Pos;
+
+  template <typename Decl> void declare(Decl &Node, VarRef::VarType Type) {
+    unsigned Idx = 0;
+    for (llvm::SmallVector<llvm::StringRef>::const_iterator I = Node.varBegin(), E = Node.varEnd(); I != E;
+         ++I, ++Idx) {
+      if (Globals.insert({*I, {VarRef(Type, 0), Pos}}).second) {
+        unsigned &Num = Type == VarRef::Bool ? NumBoolSlots : NumIntSlots;
+        Globals[*I].Ref = VarRef(Type, Num++);
+        Node.setRef(Idx, Globals[*I].Ref);
+      }
+    }
+  }
+
+public:
+  unsigned NumIntSlots;
+  unsigned NumBoolSlots;
+
+  TopLevelCollector(TopLevelDecls &Globals) : Globals(Globals), Pos(0), NumIntSlots(0), NumBoolSlots(0) {}
+
+  virtual void visit(Program &Node) override {
+    for (llvm::SmallVector<AST *>::const_iterator I = Node.begin(), E = Node.end(); I != E; ++I, ++Pos)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(DeclarationInt &Node) override { declare(Node, VarRef::Int); };
+  virtual void visit(DeclarationBool &Node) override { declare(Node, VarRef::Bool); };
+
+  // Nothing else declares a top-level variable
+  virtual void visit(Final &) override {};
+  virtual void visit(BinaryOp &) override {};
+  virtual void visit(UnaryOp &) override {};
+  virtual void visit(SignedNumber &) override {};
+  virtual void visit(NegExpr &) override {};
+  virtual void visit(Assignment &) override {};
+  virtual void visit(Comparison &) override {};
+  virtual void visit(LogicalExpr &) override {};
+  virtual void visit(IfStmt &) override {};
+  virtual void visit(WhileStmt &) override {};
+  virtual void visit(elifStmt &) override {};
+  virtual void visit(ForStmt &) override {};
+  virtual void visit(PrintStmt &) override {};
+  virtual void visit(SwitchStmt &) override {};
+  virtual void visit(CaseStmt &) override {};
+};
 }
 
-bool Sema::semantic(Program *Tree) {
+bool Sema::semantic(Program *Tree, unsigned Threads) {
   if (!Tree)
     return false; // If the input AST is not valid, return false indicating no errors
-  nms::InputCheck *Check = new nms::InputCheck();;// Create an instance of the InputCheck class for semantic analysis
-  Tree->accept(*Check); // Initiate the semantic analysis by traversing the AST using the accept function
 
-  return Check->hasError(); // Return the result of Check.hasError() indicating if any errors were detected during the analysis
+  unsigned NumStmts = Tree->end() - Tree->begin();
+  if (Threads <= 1 || NumStmts < 2) {
+    nms::InputCheck *Check = new nms::InputCheck(llvm::errs());;// Create an instance of the InputCheck class for semantic analysis
+    Tree->accept(*Check); // Initiate the semantic analysis by traversing the AST using the accept function
+
+    return Check->hasError(); // Return the result of Check.hasError() indicating if any errors were detected during the analysis
+  }
+
+  // Phase one: record every top-level declaration and its position.
+  nms::TopLevelDecls Globals;
+  nms::TopLevelCollector Collector(Globals);
+  Tree->accept(Collector);
+
+  // Phase two: check chunks of top-level statements in parallel. Each chunk
+  // only reads the top-level declarations, and writes its diagnostics to a
+  // buffer of its own that is printed in source order afterwards.
+  unsigned NumChunks = std::min(NumStmts, Threads * 4);
+  llvm::SmallVector<std::string> Diags(NumChunks);
+  llvm::SmallVector<char> Errors(NumChunks, false);
+  llvm::ThreadPool Pool(llvm::hardware_concurrency(Threads));
+  for (unsigned C = 0; C != NumChunks; ++C) {
+    Pool.async([&, C] {
+      llvm::raw_string_ostream Diag(Diags[C]);
+      nms::InputCheck Check(Diag, Globals, Collector.NumIntSlots, Collector.NumBoolSlots);
+      Check.checkRange(*Tree, (uint64_t)NumStmts * C / NumChunks, (uint64_t)NumStmts * (C + 1) / NumChunks);
+      Errors[C] = Check.hasError();
+    });
+  }
+  Pool.wait();
+
+  bool HasError = false;
+  for (unsigned C = 0; C != NumChunks; ++C) {
+    llvm::errs() << Diags[C];
+    HasError |= Errors[C];
+  }
+  return HasError;
+}
+
+bool Sema::semanticStatement(Program *Stmts, llvm::ArrayRef<std::pair<llvm::StringRef, VarRef::VarType>> Visible,
+                             llvm::raw_ostream &Diag) {
+  nms::InputCheck Check(Diag);
+  for (const std::pair<llvm::StringRef, VarRef::VarType> &V : Visible)
+    Check.declareVisible(V.first, V.second);
+  Stmts->accept(Check);
+  return Check.hasError();
 }
@@ -3,10 +3,21 @@
 
 #include "AST.h"
 #include "Lexer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/raw_ostream.h"
 
 class Sema {
 public:
-  bool semantic(Program *Tree);
+  // Checks the program and returns true if errors were found. With more than
+  // one thread, top-level declarations are collected first and the statements
+  // are then checked in parallel chunks.
+  bool semantic(Program *Tree, unsigned Threads = 1);
+
+  // Checks top-level statements on their own, as if the top-level variables
+  // in Visible had been declared before them, in that order. Diagnostics go
+  // to Diag. Returns true if errors were found.
+  bool semanticStatement(Program *Stmts, llvm::ArrayRef<std::pair<llvm::StringRef, VarRef::VarType>> Visible,
+                         llvm::raw_ostream &Diag);
 };
 
 #endif
\ No newline at end of file
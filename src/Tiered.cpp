@@ -0,0 +1,313 @@
+#include "Tiered.h"
+#include "Runtime.h"
+#include <csignal>
+#include <unordered_map>
+
+namespace ntier{
+// What the interpreter knows about a loop
+struct LoopState
+{
+  unsigned BackEdges = 0;
+  LoopJIT::LoopFn Fn = nullptr; // Null until the loop is compiled
+  unsigned NumInts = 0;         // Slots Fn reads
+  unsigned NumBools = 0;
+};
+
+class Interpreter : public ASTVisitor {
+  llvm::SmallVector<int32_t> Ints; // Values of int variables, indexed by Sema's slot
+  llvm::SmallVector<bool> Bools;   // Values of bool variables, laid out as i1 in memory
+  LoopJIT &JIT;
+  unsigned HotLoop;
+  std::unordered_map<AST *, LoopState> Loops; // Stays put while inner loops are added
+  int32_t Val; // Value of the expression visited last
+
+  static int32_t wrap(uint32_t V) { return (int32_t)V; }
+
+  int32_t &intVar(VarRef R) {
+    if (Ints.size() <= R.getSlot())
+      Ints.resize(R.getSlot() + 1, 0);
+    return Ints[R.getSlot()];
+  }
+
+  bool &boolVar(VarRef R) {
+    if (Bools.size() <= R.getSlot())
+      Bools.resize(R.getSlot() + 1, false);
+    return Bools[R.getSlot()];
+  }
+
+  int32_t load(VarRef R) { return R.isBool() ? boolVar(R) : intVar(R); }
+
+  void store(VarRef R, int32_t V) {
+    if (R.isBool())
+      boolVar(R) = V;
+    else
+      intVar(R) = V;
+  }
+
+  int32_t eval(AST *Node) {
+    Node->accept(*this);
+    return Val;
+  }
+
+  // sdiv and srem trap on these
+  void checkDivision(int32_t L, int32_t R) {
+    if (R == 0 || (L == INT32_MIN && R == -1))
+      std::raise(SIGFPE);
+  }
+
+  void run(llvm::SmallVector<AST *>::const_iterator I, llvm::SmallVector<AST *>::const_iterator E) {
+    for (; I != E; ++I)
+      (*I)->accept(*this);
+  }
+
+  // Counts a back-edge of Loop and compiles it when it becomes hot. Returns
+  // whether the rest of the loop runs in compiled code.
+  bool backEdge(AST *Loop, LoopState &S) {
+    if (++S.BackEdges == HotLoop)
+      S.Fn = JIT.compile(Loop, S.NumInts, S.NumBools);
+    return S.Fn;
+  }
+
+  // Runs the compiled code of a loop from its header
+  void enter(LoopState &S) {
+    if (Ints.size() < S.NumInts)
+      Ints.resize(S.NumInts, 0);
+    if (Bools.size() < S.NumBools)
+      Bools.resize(S.NumBools, false);
+    S.Fn(Ints.data(), Bools.data());
+  }
+
+public:
+  Interpreter(LoopJIT &JIT, unsigned HotLoop) : JIT(JIT), HotLoop(HotLoop), Val(0) {}
+
+  virtual void visit(Program &Node) override {
+    run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(Final &Node) override {
+    if (Node.getKind() == Final::Ident)
+      Val = load(Node.getRef());
+    else
+      Node.getVal().getAsInteger(10, Val);
+  };
+
+  virtual void visit(SignedNumber &Node) override {
+    Node.getValue().getAsInteger(10, Val);
+    if (Node.getSign() == SignedNumber::Minus)
+      Val = wrap(0u - (uint32_t)Val);
+  };
+
+  virtual void visit(UnaryOp &Node) override {
+    // Like the generated code, the expression has the updated value
+    int32_t &V = intVar(Node.getRef());
+    V = wrap((uint32_t)V + (Node.getOperator() == UnaryOp::Plus_plus ? 1u : -1u));
+    Val = V;
+  };
+
+  virtual void visit(NegExpr &Node) override {
+    Val = wrap(0u - (uint32_t)eval(Node.getExpr()));
+  };
+
+  virtual void visit(BinaryOp &Node) override {
+    int32_t L = eval(Node.getLeft());
+    int32_t R = eval(Node.getRight());
+    switch (Node.getOperator())
+    {
+    case BinaryOp::Plus:
+      Val = wrap((uint32_t)L + (uint32_t)R);
+      break;
+    case BinaryOp::Minus:
+      Val = wrap((uint32_t)L - (uint32_t)R);
+      break;
+    case BinaryOp::Mul:
+      Val = wrap((uint32_t)L * (uint32_t)R);
+      break;
+    case BinaryOp::Div:
+      checkDivision(L, R);
+      Val = L / R;
+      break;
+    case BinaryOp::Mod:
+      checkDivision(L, R);
+      Val = L % R;
+      break;
+    case BinaryOp::Exp: {
+      // Matches CreateExp: L multiplied R times, 1 for R <= 0
+      uint32_t Base = L, Res = 1;
+      for (uint32_t E = R > 0 ? R : 0; E; E >>= 1) {
+        if (E & 1)
+          Res *= Base;
+        Base *= Base;
+      }
+      Val = wrap(Res);
+      break;
+    }
+    default:
+      break;
+    }
+  };
+
+  virtual void visit(Comparison &Node) override {
+    switch (Node.getOperator())
+    {
+    case Comparison::True:
+      Val = 1;
+      return;
+    case Comparison::False:
+      Val = 0;
+      return;
+    case Comparison::Ident:
+      Val = load(((Final *)Node.getLeft())->getRef());
+      return;
+    default:
+      break;
+    }
+    int32_t L = eval(Node.getLeft());
+    int32_t R = eval(Node.getRight());
+    switch (Node.getOperator())
+    {
+    case Comparison::Equal:
+      Val = L == R;
+      break;
+    case Comparison::Not_equal:
+      Val = L != R;
+      break;
+    case Comparison::Greater:
+      Val = L > R;
+      break;
+    case Comparison::Less:
+      Val = L < R;
+      break;
+    case Comparison::Greater_equal:
+      Val = L >= R;
+      break;
+    case Comparison::Less_equal:
+      Val = L <= R;
+      break;
+    default:
+      break;
+    }
+  };
+
+  virtual void visit(LogicalExpr &Node) override {
+    // The right operand is only evaluated if the left one does not decide
+    int32_t L = eval(Node.getLeft());
+    if (!Node.getRight())
+      return;
+    if (Node.getOperator() == LogicalExpr::And ? !L : L) {
+      Val = L != 0;
+      return;
+    }
+    Val = eval(Node.getRight()) != 0;
+  };
+
+  virtual void visit(Assignment &Node) override {
+    int32_t R = Node.getRightExpr() ? eval(Node.getRightExpr()) : eval(Node.getRightLogic());
+    VarRef Ref = Node.getLeft()->getRef();
+    int32_t V = load(Ref);
+    switch (Node.getAssignKind())
+    {
+    case Assignment::Assign:
+      V = R;
+      break;
+    case Assignment::Plus_assign:
+      V = wrap((uint32_t)V + (uint32_t)R);
+      break;
+    case Assignment::Minus_assign:
+      V = wrap((uint32_t)V - (uint32_t)R);
+      break;
+    case Assignment::Star_assign:
+      V = wrap((uint32_t)V * (uint32_t)R);
+      break;
+    case Assignment::Slash_assign:
+      checkDivision(V, R);
+      V = V / R;
+      break;
+    }
+    store(Ref, V);
+  };
+
+  virtual void visit(DeclarationInt &Node) override {
+    // All initializers are evaluated before any of the variables is stored
+    llvm::SmallVector<int32_t, 8> Vals;
+    for (llvm::SmallVector<Expr *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      Vals.push_back(*I ? eval(*I) : 0);
+    for (unsigned I = 0, E = Vals.size(); I != E; ++I)
+      intVar(Node.getRef(I)) = Vals[I];
+  };
+
+  virtual void visit(DeclarationBool &Node) override {
+    llvm::SmallVector<int32_t, 8> Vals;
+    for (llvm::SmallVector<Logic *>::const_iterator I = Node.valBegin(), E = Node.valEnd(); I != E; ++I)
+      Vals.push_back(*I ? eval(*I) : 0);
+    for (unsigned I = 0, E = Vals.size(); I != E; ++I)
+      boolVar(Node.getRef(I)) = Vals[I];
+  };
+
+  virtual void visit(PrintStmt &Node) override {
+    if (Node.getRef().isBool())
+      print_bool(boolVar(Node.getRef()));
+    else
+      print_int(intVar(Node.getRef()));
+  };
+
+  virtual void visit(IfStmt &Node) override {
+    if (eval(Node.getCond())) {
+      run(Node.begin(), Node.end());
+      return;
+    }
+    for (llvm::SmallVector<elifStmt *>::const_iterator I = Node.beginElif(), E = Node.endElif(); I != E; ++I)
+      if (eval((*I)->getCond())) {
+        (*I)->accept(*this);
+        return;
+      }
+    run(Node.beginElse(), Node.endElse());
+  };
+
+  virtual void visit(elifStmt &Node) override {
+    run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(SwitchStmt &Node) override {
+    // Control enters at the matching arm and falls through the ones after it
+    for (llvm::SmallVector<CaseStmt *>::const_iterator I = Node.findArm(eval(Node.getCond())), E = Node.end(); I != E; ++I)
+      (*I)->accept(*this);
+  };
+
+  virtual void visit(CaseStmt &Node) override {
+    run(Node.begin(), Node.end());
+  };
+
+  virtual void visit(WhileStmt &Node) override {
+    LoopState &S = Loops[&Node];
+    if (!S.Fn)
+      do {
+        if (!eval(Node.getCond()))
+          return;
+        run(Node.begin(), Node.end());
+      } while (!backEdge(&Node, S));
+    enter(S);
+  };
+
+  virtual void visit(ForStmt &Node) override {
+    Node.getFirst()->accept(*this);
+    LoopState &S = Loops[&Node];
+    if (!S.Fn)
+      do {
+        if (!eval(Node.getSecond()))
+          return;
+        run(Node.begin(), Node.end());
+        if (Node.getThirdAssign())
+          Node.getThirdAssign()->accept(*this);
+        else
+          Node.getThirdUnary()->accept(*this);
+      } while (!backEdge(&Node, S));
+    enter(S);
+  };
+};
+}
+
+void TieredRunner::run(Program *Tree) {
+  ntier::Interpreter I(JIT, HotLoop);
+  Tree->accept(I);
+  fflush(stdout);
+}
@@ -0,0 +1,26 @@
+#ifndef TIERED_H
+#define TIERED_H
+
+#include "AST.h"
+#include "CodeGen.h"
+
+// TieredRunner starts a program at once in an interpreter and moves its hot
+// loops to native code. The interpreter counts the back-edges each loop takes;
+// when a loop has taken HotLoop of them, LoopJIT compiles that loop alone and
+// the run continues in the compiled code from the loop header, with the
+// variables handed over in the interpreter's slot arrays. Later runs of the
+// loop start in the compiled code. A short program never waits for LLVM, and
+// one spending its time in loops runs them at the speed of compiled code.
+class TieredRunner
+{
+  LoopJIT JIT;
+  unsigned HotLoop;
+
+public:
+  TieredRunner(unsigned OptLevel, unsigned HotLoop) : JIT(OptLevel), HotLoop(HotLoop) {}
+
+  // Runs the checked program, printing with the runtime. A division that
+  // traps in the generated code raises SIGFPE.
+  void run(Program *Tree);
+};
+#endif